@@ -3,10 +3,9 @@
 
 #include "types.h"
 
-#define MAX_ANIMS 1024
-
+// Starts out zeroed; the step functions grow it to fit the board.
 struct anim_queue {
-	u32 len;
+	u32 len, max_len;
 	struct anim {
 		enum {
 			ANIMATION_BULLET_MOVE,
@@ -28,7 +27,7 @@ struct anim_queue {
 				u32 sx, sy, ex, ey;
 			} player_move;
 		};
-	} queue[MAX_ANIMS];
+	} *queue;
 };
 
 #define MAX_EXPLOSIONS      1024
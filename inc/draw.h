@@ -4,6 +4,7 @@
 #include <SDL.h>
 
 #include "types.h"
+#include "anim.h"
 #include "puzzle.h"
 
 void draw_puzzle(SDL_Renderer *renderer, SDL_Texture *sprite_tex, struct puzzle *puzzle,
@@ -5,18 +5,42 @@
 
 #include "anim.h"
 #include "puzzle.h"
+#include "map.h"
 
-#define MAX_MOVES           4096
+// Bytes of per-move history kept for undo and scrubbing, 4096 moves. Moves
+// older than that are folded into the base checkpoint and can no longer be
+// undone.
+#ifndef HISTORY_BUDGET
+#define HISTORY_BUDGET      16384
+#endif
+#define HISTORY_LEN         (HISTORY_BUDGET / sizeof(struct history_entry))
+
+struct history_entry {
+	u16 x, y;
+};
 
 struct game_state {
-	struct puzzle puzzle, reset;
+	struct puzzle puzzle;
+	struct puzzle_snapshot reset, base;
 	struct solution solution;
+	// set when (s) found no solution to show, until the next move or reset
+	u32 no_solution;
+	// the solve's goal-rooted costs, and what they say about the player now
+	struct map goal_map;
+	struct hint hint;
+	u32 show_hint;
 	struct anim_queue anim_queue;
-	u32 num_moves;
-	enum player_move moves[MAX_MOVES];
+	u32 num_moves, num_recorded, base_tick;
+	// set while the timeline is being dragged with the left button
+	u32 scrubbing;
+	// player position after each move, indexed by tick % HISTORY_LEN
+	struct history_entry history[HISTORY_LEN];
+	enum move_response last_response;
 	SDL_Renderer *renderer;
 	SDL_Texture  *sprite_tex;
 	SDL_Texture  *target_tex;
+	u32 target_w, target_h;
+	f32 target_scale;
 	SDL_Texture  *font_tex;
 	u32 animating;
 	u32 last_tick, anim_tick;
@@ -3,8 +3,10 @@
 
 #include "puzzle.h"
 
-void generate_easy_puzzle(struct puzzle *puzzle);
-void generate_medium_puzzle(struct puzzle *puzzle);
-void generate_hard_puzzle(struct puzzle *puzzle);
+// Each returns 0, leaving the puzzle as it was, if none of its candidates
+// could be mapped and given a goal.
+u32 generate_easy_puzzle(struct puzzle *puzzle);
+u32 generate_medium_puzzle(struct puzzle *puzzle);
+u32 generate_hard_puzzle(struct puzzle *puzzle);
 
 #endif
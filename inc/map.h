@@ -0,0 +1,141 @@
+#ifndef __MAP_H__
+#define __MAP_H__
+
+#include <stdio.h>
+
+#include "types.h"
+#include "puzzle.h"
+
+// get_furthest_point on maps of at least MAP_PARALLEL_STATES states splits
+// each layer between up to MAP_THREADS threads.
+#ifndef MAP_THREADS
+#define MAP_THREADS          8
+#endif
+#ifndef MAP_PARALLEL_STATES
+#define MAP_PARALLEL_STATES  (1 << 22)
+#endif
+// generate_map won't build a map of more than MAP_MAX_STATES states, about
+// 6.6 bytes each with u32 costs, and leaves it empty with period 0 instead.
+#ifndef MAP_MAX_STATES
+#define MAP_MAX_STATES       (1u << 28)
+#endif
+// furthest_costs searches from 64 cells at once while the map holds at most
+// FURTHEST_MAX_STATES states, taking about 25 bytes of scratch each (50 MB at
+// the cap), and from one cell at a time with fill_map_costs above that.
+#ifndef FURTHEST_MAX_STATES
+#define FURTHEST_MAX_STATES  (1 << 21)
+#endif
+
+// The puzzle unrolled over one emitter period and padded with a wall border.
+// Each page is a bitset of width*height cells, rounded up to page_words
+// 64-bit words, and cell (x, y) of page p has index
+// p*page_words*64 + y*width + x. blocked has a bit per index the player can't
+// stand on, padding included. from[FROM_N..W] has a bit per index a bullet
+// travelling that way has just left, which the player can't step onto
+// against it. Identical pages of blocked and from are kept once: page p of a
+// plane is stored at page[p]*page_words, see map_plane. Costs are BFS
+// distances, 0 when not reached, kept in u16 when every distance fits and in
+// u32 otherwise. paths is only there after track_map_paths: the number of
+// distinct shortest move sequences from each state to the BFS start,
+// saturating at 2^64 - 1.
+enum {
+	FROM_N,
+	FROM_E,
+	FROM_S,
+	FROM_W,
+	NUM_FROM,
+};
+
+struct map {
+	u32 width, height, period;
+	u32 page_words;
+	u32 size;  // period * page_words * 64
+	u32 num_pages;  // distinct pages stored
+	u32 *page;
+	u64 *blocked;
+	u64 *from[NUM_FROM];
+	u16 *cost16;
+	u32 *cost32;
+	u64 *paths;
+};
+
+static inline u32 map_index(struct map *map, u32 x, u32 y, u32 p) {
+	return p * map->page_words * 64 + y * map->width + x;
+}
+
+static inline u32 map_bit(u64 *plane, u32 i) {
+	return (plane[i / 64] >> (i % 64)) & 1;
+}
+
+static inline u64 *map_plane(struct map *map, u64 *plane, u32 p) {
+	return plane + map->page[p] * map->page_words;
+}
+
+// Bit i of blocked or a from plane, for a map index i.
+static inline u32 map_plane_bit(struct map *map, u64 *plane, u32 i) {
+	u32 page = map->page_words * 64, p = i / page;
+	return map_bit(map_plane(map, plane, p), i - p*page);
+}
+
+static inline u32 map_cost(struct map *map, u32 i) {
+	return map->cost16 ? map->cost16[i] : map->cost32[i];
+}
+
+// States in the puzzle's map, saturating at 2^64 - 1.
+u64 map_states(struct puzzle *puzzle);
+struct map generate_map(struct puzzle *puzzle);
+// Take emitter i's bullets off the map and put them back, to retune one
+// emitter without generate_map: remove, change how it fires, add. Only the
+// cells along its rays are redrawn. The tiles, the emitter's own place
+// included, must be as the map was built from. add_map_emitter returns 0 and
+// leaves the map alone if the emitter's firing doesn't repeat within the
+// map's period. Both leave the costs stale and every page stored on its own.
+void remove_map_emitter(struct map *map, struct puzzle *puzzle, u32 i);
+u32 add_map_emitter(struct map *map, struct puzzle *puzzle, u32 i);
+void reset_map(struct map *map);
+void track_map_paths(struct map *map);
+// Frees the path counts once they have been read, keeping the costs.
+void drop_map_paths(struct map *map);
+void free_map(struct map *map);
+void print_map_page(FILE *out, struct map *map, u32 page);
+struct goal {
+	u32 x, y, p, cost, others;
+	u64 paths;  // shortest ways back from (x, y, p), 0 unless tracked
+};
+struct goal get_furthest_point(struct map *map, u32 x, u32 y);
+// get_furthest_point without picking a goal: fills in the costs from (x, y)
+// and returns the furthest one.
+u32 fill_map_costs(struct map *map, u32 x, u32 y);
+// fill_map_costs for every cell at once, into costs[y*width + x], 0 for the
+// border and cells blocked on every page. Leaves the map's own costs stale.
+void furthest_costs(struct map *map, u32 *costs);
+
+// What the cost field says about the player at (x, y), in puzzle
+// coordinates, p ticks after page 0: whether the BFS start can still be
+// reached, how many moves that takes and the first move of a shortest way.
+// An empty map reaches nothing.
+struct hint {
+	u32 reachable, moves_left;
+	enum player_move next;
+};
+
+struct hint map_hint(struct map *map, u32 x, u32 y, u32 p);
+
+// Strongly connected regions of the forward graph over open states. region
+// is per map index, ~0 for blocked states. A sink region has no move out of
+// it: a player who enters one can only reach the states inside it.
+struct map_regions {
+	u32 num_regions;
+	u32 *region;
+	u32 *sizes;
+	u32 num_states, largest;
+	u32 num_sinks, sink_states;
+};
+
+void find_map_regions(struct map_regions *regions, struct map *map);
+void free_map_regions(struct map_regions *regions);
+// Whether some state of cell (x0, y0) shares a region with one of (x1, y1).
+u32 cells_share_region(struct map_regions *regions, struct map *map,
+                       u32 x0, u32 y0, u32 x1, u32 y1);
+
+#endif
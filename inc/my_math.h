@@ -5,5 +5,9 @@
 
 u32 hcf_u32(u32 a, u32 b);
 u32 lcm_u32(u32 a, u32 b);
+// lcm_u64 and mul_u64 saturate at 2^64 - 1 instead of wrapping.
+u64 hcf_u64(u64 a, u64 b);
+u64 lcm_u64(u64 a, u64 b);
+u64 mul_u64(u64 a, u64 b);
 
 #endif
@@ -1,19 +1,30 @@
 #ifndef __PUZZLE_H__
 #define __PUZZLE_H__
 
+#include <stdio.h>
+
 #include "types.h"
-#include "anim.h"
+
+struct anim_queue;
+struct map;
 
 #define MAX(x, y) (x > y ? x : y)
-#define MAX_EMITTERS 32
-#define MAX_WIDTH    32
-#define MAX_HEIGHT   32
-#define MAX_SIZE     (MAX_WIDTH * MAX_HEIGHT)
-#define MAX_BULLETS  (MAX_EMITTERS * 8 * MAX(MAX_WIDTH, MAX_HEIGHT))
-#define MAX_SOLUTION_LENGTH 1024
+#define MIN(x, y) (x < y ? x : y)
+// Largest board supported, checked by resize_puzzle. The puzzle's own arrays
+// are allocated for the board they hold, but snapshots keep emitter
+// coordinates in a u8, print_puzzle formats a row in a MAX_WIDTH buffer and
+// the single-word bitboard shift keeps a MAX_HEIGHT row buffer on the stack.
+// That is what the simulation can hold, not what the generator can make: its
+// furthest_costs pass grows with cells times states, about 0.1 s a candidate
+// at 32x32 and 3 s at 64x64, so generated boards stay at or below 32x32.
+#define MAX_WIDTH    256
+#define MAX_HEIGHT   256
 
 #define NUM_DIRS 8
 
+extern const s32 dir_dx[NUM_DIRS];
+extern const s32 dir_dy[NUM_DIRS];
+
 enum player_move {
 	PLAYER_MOVE_N,
 	PLAYER_MOVE_E,
@@ -28,12 +39,15 @@ enum move_response {
 	MOVE_RESPONSE_VICTORY,
 };
 
+// The arrays are sized for the board by resize_puzzle. A puzzle has to start
+// out zeroed and is released with free_puzzle; copy one through a snapshot.
 struct puzzle {
 	u32 width, height;
 	struct {
 		u32 x, y;
 	} player;
-	u32 num_emitters;
+	u32 tick;
+	u32 num_emitters, max_bullets;
 	struct emitter {
 		enum {
 			EMITTER_FIXED,
@@ -43,45 +57,120 @@ struct puzzle {
 		u32 x, y;
 		u32 dir_mask;
 		u32 step, num_steps, fire_mask;
-	} emitters[MAX_EMITTERS];
+	} *emitters;
 	u32 num_bullets;
-	struct bullet {
-		u32 x, y;
-		enum direction dir;
-	} bullets[MAX_BULLETS];
+	struct bullets {
+		u16 *x, *y;
+		u16 *dx, *dy; // two's complement, -1 is 0xFFFF
+	} bullets;
+	// bit d of occupancy[y*width + x] is set while a bullet travelling in
+	// direction d is on (x, y); kept in step with the bullet list
+	u8 *occupancy;
 	enum tile {
 		TILE_EMPTY,
 		TILE_EMITTER,
 		TILE_WALL,
 		TILE_GOAL,
-	} tiles[MAX_SIZE];
+	} *tiles;
+};
+
+// Bullets as one bitplane per direction, each row words u64s long: bit x of
+// row y of plane dir is set while a bullet travelling in dir sits on (x, y).
+// Starts out zeroed; bitboard_from_puzzle sizes it.
+struct bitboard {
+	u32 height, words;
+	u64 *open;  // open[y*words + x/64]
+	u64 *rows;  // rows[(dir*height + y)*words + x/64]
 };
 
+// Bitboards of up to BATCH_LANES puzzles interleaved lane by lane, so one
+// step shifts the same row of every puzzle together. The puzzles keep their
+// own player and emitters; their bullet lists are only written back by
+// batch_to_puzzles.
+#define BATCH_LANES 16
+struct puzzle_batch {
+	u32 num_lanes, height, words;
+	struct puzzle *puzzles[BATCH_LANES];
+	u64 *open;  // open[(y*words + k)*BATCH_LANES + lane]
+	u64 *rows;  // rows[((dir*height + y)*words + k)*BATCH_LANES + lane]
+};
+
+// Everything needed to rebuild a steady-state puzzle in a bit per cell and a
+// few bytes per emitter: static layout, emitter phases, player and tick.
+// Bullets are not stored; restore_puzzle derives them from the emitters.
+// Starts out zeroed like a puzzle; copy_snapshot makes an independent copy.
+struct puzzle_snapshot {
+	u16 width, height;
+	u16 player_x, player_y;
+	u16 goal_x, goal_y;
+	u32 num_emitters;
+	u32 tick;
+	u64 *walls;  // bit y*width + x
+	struct emitter_snapshot {
+		u8 type, x, y;
+		u8 dir_mask, step, num_steps, fire_mask;
+	} *emitters;
+};
+
+// Sizes the puzzle's arrays for a board of at most MAX_WIDTH by MAX_HEIGHT
+// and an emitter count, keeping none of their contents.
+void resize_puzzle(struct puzzle *puzzle, u32 width, u32 height, u32 num_emitters);
+void free_puzzle(struct puzzle *puzzle);
 void print_puzzle(struct puzzle *puzzle);
-struct puzzle generate_puzzle(u32 width, u32 height, u32 num_emitters);
+enum direction bullet_dir(struct bullets *bullets, u32 i);
+// Directions of the bullets on (x, y) as a mask, 0 for none or off the board.
+u32 bullets_at(struct puzzle *puzzle, u32 x, u32 y);
+// Advances an emitter by one tick. Returns the directions it fires in.
+u32 step_emitter(struct emitter *e);
+void advance_emitter(struct emitter *e, u32 ticks);
+void generate_puzzle(struct puzzle *puzzle, u32 width, u32 height, u32 num_emitters);
+void snapshot_puzzle(struct puzzle_snapshot *snapshot, struct puzzle *puzzle);
+void restore_puzzle(struct puzzle *puzzle, struct puzzle_snapshot *snapshot);
+void copy_snapshot(struct puzzle_snapshot *dst, struct puzzle_snapshot *src);
+void free_snapshot(struct puzzle_snapshot *snapshot);
+// Moves the emitters of a snapshot the given number of ticks on in place.
+void advance_snapshot(struct puzzle_snapshot *snapshot, u32 ticks);
+// Restores a snapshot as it will be the given number of ticks later, leaving
+// the player where the snapshot had it. Costs the same whatever the tick.
+void seek_puzzle(struct puzzle *puzzle, struct puzzle_snapshot *snapshot, u32 ticks);
 enum move_response step_puzzle(struct puzzle *puzzle,
                                enum player_move player_move,
                                struct anim_queue *anim_queue);
+// Pause-only steps for boards whose player is parked off the board: no
+// collision checks and no animations.
+void step_puzzle_headless(struct puzzle *puzzle);
+void bitboard_from_puzzle(struct bitboard *board, struct puzzle *puzzle);
+void bitboard_to_puzzle(struct puzzle *puzzle, struct bitboard *board);
+enum move_response step_puzzle_bitboard(struct puzzle *puzzle, struct bitboard *board,
+                                        enum player_move player_move,
+                                        struct anim_queue *anim_queue);
+void free_bitboard(struct bitboard *board);
+// The puzzles may be copies of one puzzle to try different moves from it.
+void batch_from_puzzles(struct puzzle_batch *batch, struct puzzle **puzzles, u32 n);
+void batch_to_puzzles(struct puzzle_batch *batch);
+void free_batch(struct puzzle_batch *batch);
+// Steps every lane with moves[lane], or pauses all of them if moves is NULL,
+// writing each outcome to results[lane] when results isn't NULL.
+void step_puzzle_batch(struct puzzle_batch *batch, enum player_move *moves,
+                       enum move_response *results);
 
 // XXX
 
-struct map {
-	u32 width, height, period;
-	u32 *data;
-};
-struct map generate_map(struct puzzle *puzzle);
-void reset_map(struct map *map);
-void print_map_page(struct map *map, u32 page);
-struct goal {
-	u32 x, y, p, cost, others;
-};
-struct goal get_furthest_point(struct map *map, u32 x, u32 y);
-
+// Starts out zeroed; solve_puzzle sizes moves for the solution it finds.
+// paths is how many distinct shortest move sequences there are, saturating
+// at 2^64 - 1. Set trace to have solve_puzzle describe its work there.
 struct solution {
 	u32 len;
-	enum player_move moves[MAX_SOLUTION_LENGTH];
+	enum player_move *moves;
+	u64 paths;
+	FILE *trace;
 };
 
 void solve_puzzle(struct solution *solution, struct puzzle *puzzle);
+// solve_puzzle that leaves the goal-rooted cost field in map, which starts
+// out zeroed, for map_hint. Page 0 is the puzzle as it is now. A puzzle too
+// big for generate_map is searched instead and leaves map empty.
+void solve_puzzle_map(struct solution *solution, struct puzzle *puzzle, struct map *map);
+void free_solution(struct solution *solution);
 
 #endif
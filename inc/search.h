@@ -0,0 +1,37 @@
+#ifndef __SEARCH_H__
+#define __SEARCH_H__
+
+#include "types.h"
+#include "puzzle.h"
+
+// solve_puzzle searches instead of building a map once the map would hold
+// more than SEARCH_MAP_STATES states. A* gives up after remembering
+// SEARCH_MAX_STATES states and hands over to IDA*, which only keeps the
+// current path but gives up after SEARCH_IDA_NODES expansions. Both read the
+// board from pages of one tick each, built when first needed and kept in at
+// most SEARCH_PAGE_BYTES. The goal's wait is only part of the heuristic when
+// the bullets crossing it repeat within SEARCH_GOAL_PERIOD ticks.
+#ifndef SEARCH_MAP_STATES
+#define SEARCH_MAP_STATES  (1 << 26)
+#endif
+#ifndef SEARCH_MAX_STATES
+#define SEARCH_MAX_STATES  (1 << 22)
+#endif
+#ifndef SEARCH_IDA_NODES
+#define SEARCH_IDA_NODES   (1ull << 32)
+#endif
+#ifndef SEARCH_PAGE_BYTES
+#define SEARCH_PAGE_BYTES  (1 << 26)
+#endif
+#ifndef SEARCH_GOAL_PERIOD
+#define SEARCH_GOAL_PERIOD (1 << 20)
+#endif
+
+// A shortest solution found by A* over (x, y, tick mod period) without a map:
+// whether a bullet is on a cell is worked out from the emitter rays when the
+// search gets there. The heuristic is the Manhattan distance to the goal plus
+// the wait for the goal to be clear once the player could be on it. Leaves
+// solution->paths at 0, as nothing counts the other shortest solutions.
+void solve_puzzle_search(struct solution *solution, struct puzzle *puzzle);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __STENCIL_H__
+#define __STENCIL_H__
+
+#include "types.h"
+#include "puzzle.h"
+
+// Longest period bullet_density counts exactly, see there.
+#ifndef DENSITY_EXACT_PERIOD
+#define DENSITY_EXACT_PERIOD  (1 << 16)
+#endif
+
+// A bullet flies in a straight line from its emitter until it leaves the
+// board or hits an emitter or wall, so on a warmed-up board the bullet field
+// is a function of emitter phase alone. A ray is the path one emitter fires
+// along in one direction. Starts out zeroed; build_stencil sizes it.
+struct stencil {
+	u32 num_rays;
+	struct ray {
+		u32 emitter;
+		enum direction dir;
+		u32 first, len;  // cells[first .. first + len), nearest first
+		u32 period;      // shortest repeat of the firing, a divisor of the emitter's
+		u64 fire_bits;   // bit t set if the emitter fires along the ray t ticks on,
+		                 // so emitters can repeat every 64 ticks at most
+	} *rays;
+	u32 num_cells;
+	u32 *cells;  // y * width + x
+};
+
+u32 emitter_period(struct emitter *e);
+void build_stencil(struct stencil *stencil, struct puzzle *puzzle);
+// A stencil of emitter i's rays alone.
+void build_emitter_stencil(struct stencil *stencil, struct puzzle *puzzle, u32 i);
+// Ticks until the bullet field repeats, which can be well short of the
+// emitters all coming round again: rays with nowhere to go don't count, and
+// a ray repeats as soon as its firing does. Saturates at 2^64 - 1.
+u64 stencil_period(struct stencil *stencil);
+u64 puzzle_period(struct puzzle *puzzle);
+void free_stencil(struct stencil *stencil);
+// Replaces the puzzle's bullets with the field its emitters produce once the
+// board is warmed up.
+void steady_state_bullets(struct puzzle *puzzle);
+// The share of ticks each cell has a bullet on it once the board is warmed
+// up, from the rays alone: density[y*width + x], 1 for walls and emitters.
+// Returns the mean over the other cells, 0 if there are none. Exact for cells
+// whose rays all come round together within DENSITY_EXACT_PERIOD ticks; past
+// that it assumes the rays fire independently, and the figure is only an
+// estimate.
+f32 bullet_density(struct puzzle *puzzle, f32 *density);
+// Whether the bullet on a ray's m'th cell (m >= 1) is present k ticks on.
+// Only meaningful while the board is in its steady state: fully warmed up and
+// no bullet destroyed by the player.
+static inline u32 ray_occupied(struct ray *ray, u32 k, u32 m) {
+	u32 t = (k + ray->period - (m - 1) % ray->period) % ray->period;
+	return (ray->fire_bits >> t) & 1;
+}
+
+#endif
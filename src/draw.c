@@ -64,7 +64,9 @@ static s32 lerp(s32 x1, s32 x2, f32 v) {
 #define MIN_SPEED 30.0f
 #define MAX_SPEED 60.0f
 static void add_explosion(struct explosion_queue *explosion_queue, s32 x, s32 y) {
-	// TODO -- check we're not exceeding the max explosions?
+	if (explosion_queue->num_explosions == MAX_EXPLOSIONS) {
+		return;
+	}
 	struct explosion *exp = &explosion_queue->explosions[explosion_queue->num_explosions++];
 	exp->x = x; exp->y = y; exp->ticks = EXPLOSION_LEN;
 	struct particle *part = exp->particles;
@@ -226,11 +228,11 @@ drawn_player:
 				}
 			}
 		} else {
-			u32 num_bullets  = puzzle->num_bullets;
-			struct bullet *b = puzzle->bullets;
-			for (u32 i = 0; i < num_bullets; ++i, ++b) {
-				f64 angle = dir_to_angle(b->dir);
-				dst.x = b->x * TW; dst.y = b->y * TH;
+			u32 num_bullets = puzzle->num_bullets;
+			struct bullets *b = &puzzle->bullets;
+			for (u32 i = 0; i < num_bullets; ++i) {
+				f64 angle = dir_to_angle(bullet_dir(b, i));
+				dst.x = b->x[i] * TW; dst.y = b->y[i] * TH;
 				SDL_RenderCopyEx(renderer, sprite_tex, &src, &dst, angle,
 					&center, SDL_FLIP_NONE);
 			}
@@ -295,7 +297,7 @@ drawn_player:
 		SDL_Point center = { TW / 2, TH / 2 };
 		for (u32 i = 0; i < num_emitters; ++i, ++p) {
 			dst.x = p->x * TW; dst.y = p->y * TH;
-			f32 offset;
+			f32 offset = 0.0f;
 			switch (p->type) {
 			case EMITTER_FIXED:
 				offset = 0.0f;
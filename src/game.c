@@ -7,6 +7,7 @@
 
 #include "state.h"
 #include "puzzle.h"
+#include "search.h"
 #include "anim.h"
 #include "draw.h"
 #include "menu_widget.h"
@@ -28,18 +29,28 @@
 
 #define MIN(x, y) (x < y ? x : y)
 
+#define TIMELINE_H 8
+
+#define FONT_HEIGHT 16
+#define HINT_SCALE  2
+
+// longest side of the render target; larger boards get smaller tiles
+#define MAX_TARGET_DIM 4096
+
 #define PAUSE_WIDGET_UNDO          0
 #define PAUSE_WIDGET_RESET         1
 #define PAUSE_WIDGET_SHOW_SOLUTION 2
-#define PAUSE_WIDGET_CONTINUE      3
-#define PAUSE_WIDGET_MAIN_MENU     4
+#define PAUSE_WIDGET_HINT          3
+#define PAUSE_WIDGET_CONTINUE      4
+#define PAUSE_WIDGET_MAIN_MENU     5
 static struct menu_widget pause_widget = {
 	.title = "PAUSE",
-	.cur_item = 0, .num_items = 5,
+	.cur_item = 0, .num_items = 6,
 	.items = {
 		"(z) undo",
 		"(r) reset",
 		"(s) show solution",
+		"(h) hint",
 		"    continue",
 		"    main menu",
 	},
@@ -71,24 +82,76 @@ static struct menu_widget victory_widget = {
 	},
 };
 
+static struct history_entry *history_at(struct game_state *game_state, u32 tick) {
+	return &game_state->history[tick % HISTORY_LEN];
+}
+
+static const char *const move_names[] = {
+	[PLAYER_MOVE_N]     = "north",
+	[PLAYER_MOVE_E]     = "east",
+	[PLAYER_MOVE_S]     = "south",
+	[PLAYER_MOVE_W]     = "west",
+	[PLAYER_MOVE_PAUSE] = "wait",
+};
+
+// A lookup in the cost field kept from the solve: no search per move.
+static void update_hint(struct game_state *game_state, u32 x, u32 y) {
+	game_state->hint = map_hint(&game_state->goal_map, x, y, game_state->num_moves);
+}
+
+static void clear_history(struct game_state *game_state) {
+	game_state->num_moves    = 0;
+	game_state->num_recorded = 0;
+	game_state->base_tick    = 0;
+	game_state->no_solution  = 0;
+	copy_snapshot(&game_state->base, &game_state->reset);
+	history_at(game_state, 0)->x = game_state->reset.player_x;
+	history_at(game_state, 0)->y = game_state->reset.player_y;
+	update_hint(game_state, game_state->reset.player_x, game_state->reset.player_y);
+}
+
 void init_game_state(struct game_state *game_state) {
 	game_state->anim_tick = ANIM_LEN;
 	game_state->animating = 1;
-	game_state->num_moves = 0;
 	game_state->state = GAME_STATE_ALIVE;
-	memcpy(&game_state->reset, &game_state->puzzle, sizeof(game_state->puzzle));
+	snapshot_puzzle(&game_state->reset, &game_state->puzzle);
+	if (map_states(&game_state->puzzle) <= SEARCH_MAP_STATES) {
+		solve_puzzle_map(&game_state->solution, &game_state->puzzle, &game_state->goal_map);
+		// hints only read the costs
+		drop_map_paths(&game_state->goal_map);
+	} else {
+		// too big to keep a map for hints: search, and leave goal_map empty
+		free_map(&game_state->goal_map);
+		solve_puzzle(&game_state->solution, &game_state->puzzle);
+	}
+	clear_history(game_state);
+	u32 w = game_state->puzzle.width, h = game_state->puzzle.height;
+	game_state->target_scale = MIN(1.0f, (f32)MAX_TARGET_DIM / (TW * MAX(w, h)));
+	game_state->target_w = TW * w * game_state->target_scale;
+	game_state->target_h = TH * h * game_state->target_scale;
 	game_state->target_tex = SDL_CreateTexture(game_state->renderer, SDL_PIXELFORMAT_RGBA32,
 	                                           SDL_TEXTUREACCESS_TARGET,
-	                                           TW * game_state->puzzle.width,
-	                                           TH * game_state->puzzle.height);
-	solve_puzzle(&game_state->solution, &game_state->puzzle);
+	                                           game_state->target_w, game_state->target_h);
 }
 
 static void do_move(struct game_state *game_state, enum player_move move) {
-	game_state->moves[game_state->num_moves++] = move;
+	u32 tick = ++game_state->num_moves;
+	if (tick - game_state->base_tick == HISTORY_LEN) {
+		// out of history: fold the oldest move into the base checkpoint
+		struct history_entry *first = history_at(game_state, ++game_state->base_tick);
+		advance_snapshot(&game_state->base, 1);
+		game_state->base.player_x = first->x;
+		game_state->base.player_y = first->y;
+	}
 	game_state->anim_queue.len = 0;
+	game_state->no_solution = 0;
 	enum move_response move_response = step_puzzle(&game_state->puzzle,
 	                                               move, &game_state->anim_queue);
+	history_at(game_state, tick)->x = game_state->puzzle.player.x;
+	history_at(game_state, tick)->y = game_state->puzzle.player.y;
+	game_state->num_recorded  = tick;
+	game_state->last_response = move_response;
+	update_hint(game_state, game_state->puzzle.player.x, game_state->puzzle.player.y);
 	switch (move_response) {
 	case MOVE_RESPONSE_NONE:
 		break;
@@ -105,8 +168,38 @@ static void do_move(struct game_state *game_state, enum player_move move) {
 	game_state->animating = 1;
 }
 
+// Shows the attempt as it was after the given number of moves, without
+// replaying them: the board only depends on the player and emitter phases.
+// The tick has to lie between base_tick and num_recorded.
+static void seek(struct game_state *game_state, u32 tick) {
+	struct puzzle *puzzle = &game_state->puzzle;
+	seek_puzzle(puzzle, &game_state->base, tick - game_state->base_tick);
+	puzzle->player.x = history_at(game_state, tick)->x;
+	puzzle->player.y = history_at(game_state, tick)->y;
+	game_state->num_moves = tick;
+	update_hint(game_state, puzzle->player.x, puzzle->player.y);
+	game_state->anim_queue.len = 0;
+	game_state->animating = 0;
+	game_state->state = GAME_STATE_ALIVE;
+	if (tick == game_state->num_recorded) {
+		switch (game_state->last_response) {
+		case MOVE_RESPONSE_NONE:
+			break;
+		case MOVE_RESPONSE_DEATH:
+			game_state->state = GAME_STATE_OVER;
+			game_over_widget.cur_item = 0;
+			break;
+		case MOVE_RESPONSE_VICTORY:
+			game_state->state = GAME_STATE_VICTORY;
+			victory_widget.cur_item = 0;
+			break;
+		}
+	}
+}
+
 void run_game(struct game_state *game_state) {
 	SDL_Event e;
+	s32 scrub_x;
 	while (SDL_PollEvent(&e)) {
 		switch (game_state->state) {
 		case GAME_STATE_OVER:
@@ -162,6 +255,35 @@ void run_game(struct game_state *game_state) {
 					goto reset;
 				case SDLK_s:
 					goto show_solution;
+				case SDLK_h:
+					goto toggle_hint;
+				case SDLK_COMMA:
+					goto rewind;
+				case SDLK_PERIOD:
+					goto fast_forward;
+				case SDLK_HOME:
+					goto rewind_to_start;
+				case SDLK_END:
+					goto fast_forward_to_end;
+				}
+				break;
+			case SDL_MOUSEBUTTONDOWN:
+				if (e.button.button == SDL_BUTTON_LEFT && e.button.y >= SH - TIMELINE_H
+				 && game_state->num_recorded > game_state->base_tick) {
+					game_state->scrubbing = 1;
+					scrub_x = e.button.x;
+					goto scrub;
+				}
+				break;
+			case SDL_MOUSEMOTION:
+				if (game_state->scrubbing && (e.motion.state & SDL_BUTTON_LMASK)) {
+					scrub_x = e.motion.x;
+					goto scrub;
+				}
+				break;
+			case SDL_MOUSEBUTTONUP:
+				if (e.button.button == SDL_BUTTON_LEFT) {
+					game_state->scrubbing = 0;
 				}
 				break;
 			case SDL_CONTROLLERBUTTONUP:
@@ -185,6 +307,12 @@ void run_game(struct game_state *game_state) {
 				case SDL_CONTROLLER_BUTTON_START:
 				case SDL_CONTROLLER_BUTTON_BACK:
 					goto show_menu;
+				case SDL_CONTROLLER_BUTTON_LEFTSHOULDER:
+					goto rewind;
+				case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER:
+					goto fast_forward;
+				case SDL_CONTROLLER_BUTTON_LEFTSTICK:
+					goto toggle_hint;
 				}
 				break;
 			case SDL_CONTROLLERAXISMOTION:
@@ -224,6 +352,9 @@ void run_game(struct game_state *game_state) {
 				case PAUSE_WIDGET_SHOW_SOLUTION:
 					game_state->state = game_state->prev_state;
 					goto show_solution;
+				case PAUSE_WIDGET_HINT:
+					game_state->state = game_state->prev_state;
+					goto toggle_hint;
 				case PAUSE_WIDGET_CONTINUE:
 					goto leave_menu;
 				case PAUSE_WIDGET_MAIN_MENU:
@@ -264,27 +395,65 @@ void run_game(struct game_state *game_state) {
 		}
 		do_move(game_state, PLAYER_MOVE_PAUSE);
 		continue;
+	rewind:
+		if (game_state->state != GAME_STATE_SHOW_SOLUTION
+		 && game_state->num_moves > game_state->base_tick) {
+			seek(game_state, game_state->num_moves - 1);
+		}
+		continue;
+	fast_forward:
+		if (game_state->state != GAME_STATE_SHOW_SOLUTION
+		 && game_state->num_moves < game_state->num_recorded) {
+			seek(game_state, game_state->num_moves + 1);
+		}
+		continue;
+	rewind_to_start:
+		if (game_state->state != GAME_STATE_SHOW_SOLUTION) {
+			seek(game_state, game_state->base_tick);
+		}
+		continue;
+	fast_forward_to_end:
+		if (game_state->state != GAME_STATE_SHOW_SOLUTION) {
+			seek(game_state, game_state->num_recorded);
+		}
+		continue;
+	scrub:
+		// the tick whose bar ends nearest the pointer
+		if (game_state->state != GAME_STATE_SHOW_SOLUTION) {
+			u32 span = game_state->num_recorded - game_state->base_tick;
+			u32 x = scrub_x < 0 ? 0 : MIN((u32)scrub_x, SW);
+			u32 tick = game_state->base_tick + (x * span + SW / 2) / SW;
+			if (tick != game_state->num_moves) {
+				seek(game_state, tick);
+			}
+		}
+		continue;
 	reset:
-		game_state->num_moves = 0;
+		clear_history(game_state);
 		game_state->state = GAME_STATE_ALIVE;
-		memcpy(&game_state->puzzle, &game_state->reset, sizeof(game_state->puzzle));
+		restore_puzzle(&game_state->puzzle, &game_state->reset);
 		continue;
 	undo_move:
-		if (game_state->num_moves) {
-			game_state->state = GAME_STATE_ALIVE;
-			memcpy(&game_state->puzzle, &game_state->reset, sizeof(game_state->puzzle));
-			--game_state->num_moves;
-			for (u32 i = 0; i < game_state->num_moves; ++i) {
-				step_puzzle(&game_state->puzzle, game_state->moves[i], NULL);
-			}
+		if (game_state->num_moves > game_state->base_tick) {
+			game_state->num_recorded  = game_state->num_moves - 1;
+			game_state->last_response = MOVE_RESPONSE_NONE;
+			seek(game_state, game_state->num_recorded);
 		}
 		continue;
 	show_solution:
-		game_state->num_moves = 0;
+		clear_history(game_state);
+		restore_puzzle(&game_state->puzzle, &game_state->reset);
+		if (!game_state->solution.len) {
+			game_state->state = GAME_STATE_ALIVE;
+			game_state->no_solution = 1;
+			continue;
+		}
 		game_state->state = GAME_STATE_SHOW_SOLUTION;
-		memcpy(&game_state->puzzle, &game_state->reset, sizeof(game_state->puzzle));
 		do_move(game_state, game_state->solution.moves[game_state->num_moves]);
 		continue;
+	toggle_hint:
+		game_state->show_hint = !game_state->show_hint;
+		continue;
 	show_menu:
 		if (game_state->state != GAME_STATE_OVER && game_state->state != GAME_STATE_VICTORY) {
 			pause_widget.cur_item = 0;
@@ -314,7 +483,12 @@ void run_game(struct game_state *game_state) {
 			game_state->animating = 0;
 			break;
 		case GAME_STATE_SHOW_SOLUTION:
-			do_move(game_state, game_state->solution.moves[game_state->num_moves]);
+			if (game_state->num_moves < game_state->solution.len) {
+				do_move(game_state, game_state->solution.moves[game_state->num_moves]);
+			} else {
+				game_state->state = GAME_STATE_ALIVE;
+				game_state->animating = 0;
+			}
 			break;
 		}
 	} else if (game_state->animating) {
@@ -326,6 +500,7 @@ void run_game(struct game_state *game_state) {
 	SDL_RenderClear(renderer);
 
 	SDL_SetRenderTarget(renderer, game_state->target_tex);
+	SDL_RenderSetScale(renderer, game_state->target_scale, game_state->target_scale);
 	SDL_RenderClear(renderer);
 
 	SDL_Texture *sprite_tex = game_state->sprite_tex;
@@ -339,15 +514,50 @@ void run_game(struct game_state *game_state) {
 	draw_puzzle(renderer, sprite_tex, &game_state->puzzle, &game_state->anim_queue,
 	            &game_state->explosion_queue, game_state->animating, anim_fac, frame_time);
 
+	SDL_RenderSetScale(renderer, 1.0f, 1.0f);
 	SDL_SetRenderTarget(renderer, NULL);
 	{
-		s32 w = TW * game_state->puzzle.width, h = TH * game_state->puzzle.height;
-		u32 sf = MIN(SW / w, SH / h);
+		s32 w = game_state->target_w, h = game_state->target_h;
+		f32 sf = MIN((f32)SW / w, (f32)SH / h);
+		if (sf > 1.0f) {
+			// whole pixels while the board fits
+			sf = (u32)sf;
+		}
+		SDL_Rect src = { 0, 0, w, h };
 		w *= sf; h *= sf;
-		SDL_Rect src = { 0, 0, w, h }, dst = { (SW - w) / 2, (SH - h) / 2, w, h };
+		SDL_Rect dst = { (SW - w) / 2, (SH - h) / 2, w, h };
 		SDL_RenderCopy(renderer, game_state->target_tex, &src, &dst);
 	}
 
+	// draw timeline
+	if (game_state->num_recorded > game_state->base_tick) {
+		SDL_Rect r = { 0, SH - TIMELINE_H, SW, TIMELINE_H };
+		SDL_SetRenderDrawColor(renderer, 48, 32, 48, 255);
+		SDL_RenderFillRect(renderer, &r);
+		r.w = SW * (game_state->num_moves - game_state->base_tick)
+		    / (game_state->num_recorded - game_state->base_tick);
+		SDL_SetRenderDrawColor(renderer, 160, 96, 160, 255);
+		SDL_RenderFillRect(renderer, &r);
+	}
+
+	if (game_state->no_solution && game_state->state == GAME_STATE_ALIVE) {
+		draw_string(renderer, font_tex, "no solution to show",
+		            0, SH - TIMELINE_H - FONT_HEIGHT * HINT_SCALE, HINT_SCALE, 255, 255, 255);
+	} else if (game_state->show_hint && game_state->state == GAME_STATE_ALIVE) {
+		struct hint *hint = &game_state->hint;
+		char text[64];
+		if (!game_state->goal_map.period) {
+			snprintf(text, sizeof(text), "no hints on a board this big");
+		} else if (!hint->reachable) {
+			snprintf(text, sizeof(text), "no way to the goal from here");
+		} else {
+			snprintf(text, sizeof(text), "%u moves left, next: %s",
+			         hint->moves_left, move_names[hint->next]);
+		}
+		draw_string(renderer, font_tex, text, 0, SH - TIMELINE_H - FONT_HEIGHT * HINT_SCALE,
+		            HINT_SCALE, 255, 255, 255);
+	}
+
 	if (game_state->state == GAME_STATE_OVER) {
 		SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
 		SDL_Rect r = { 0, 0, SW, SH };
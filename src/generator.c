@@ -6,65 +6,134 @@
 
 #include "types.h"
 #include "puzzle.h"
+#include "map.h"
+#include "stencil.h"
+
+// Candidates whose largest strongly connected region holds less than this
+// share of the open states are dropped before the goal search. Off by
+// default: on the stock sizes the region pass costs about as much as the
+// search it would save, and such candidates rarely win anyway.
+#ifndef MIN_REGION_PERCENT
+#define MIN_REGION_PERCENT  0
+#endif
+
+// Candidates whose open cells average a bullet density more than
+// DENSITY_TOLERANCE_PERCENT away from TARGET_DENSITY_PERCENT are dropped
+// before their map is built. Off while the target is 0.
+#ifndef TARGET_DENSITY_PERCENT
+#define TARGET_DENSITY_PERCENT     0
+#endif
+#ifndef DENSITY_TOLERANCE_PERCENT
+#define DENSITY_TOLERANCE_PERCENT  5
+#endif
 
 typedef s32 (*goal_compare)(struct goal *g1, struct goal *g2);
 
-static void generate(struct puzzle *puzzle,
-                     goal_compare is_better,
-                     u32 w, u32 h, u32 num_emitters, u32 puzzles_to_try) {
-	u32 best_x, best_y;
-	struct puzzle best_puzzle;
+// Returns 0, leaving puzzle alone, when no candidate could be scored.
+static u32 generate(struct puzzle *puzzle,
+                    goal_compare is_better,
+                    u32 w, u32 h, u32 num_emitters, u32 puzzles_to_try) {
+	u32 best_x = 0, best_y = 0;
+	u32 chosen = 0;
+	struct puzzle this_puzzle = {};
+	struct puzzle_snapshot best_puzzle = {};
 	struct goal   best_puzzle_goal = {
 		.x = 0, .y = 0, .p = 0, .cost = 0, .others = 1000,
 	};
-	for (u32 i = 0; i < puzzles_to_try; ++i) {
-		u32 this_x, this_y;
+	u32 *costs = NULL;
+	f32 *density = NULL;
+	struct map_regions regions = {};
+	// up to puzzles_to_try more while there's no puzzle at all: a candidate
+	// too big to map can't be scored, so it's no last chance
+	for (u32 i = 0; i < puzzles_to_try || (!chosen && i < 2 * puzzles_to_try); ++i) {
+		u32 this_x = 0, this_y = 0;
 		struct goal best_goal = {
 			.x = 0, .y = 0, .p = 0, .cost = 0, .others = 1000,
 		};
 		// TODO -- change generator?
-		struct puzzle this_puzzle = generate_puzzle(w, h, num_emitters);
+		generate_puzzle(&this_puzzle, w, h, num_emitters);
+		if (TARGET_DENSITY_PERCENT && (best_puzzle_goal.cost || i + 1 < puzzles_to_try)) {
+			density = realloc(density, w * h * sizeof(*density));
+			f32 off = bullet_density(&this_puzzle, density) * 100 - TARGET_DENSITY_PERCENT;
+			if (off > DENSITY_TOLERANCE_PERCENT || off < -DENSITY_TOLERANCE_PERCENT) {
+				continue;
+			}
+		}
 		struct map map = generate_map(&this_puzzle);
-		for (u32 x = 0; x < w; ++x) {
-			for (u32 y = 0; y < h; ++y) {
-				reset_map(&map);
-				struct goal this_goal = get_furthest_point(&map, x, y);
+		if (!map.period) {
+			continue;
+		}
+		// never drop the last chance of having any puzzle at all
+		if (MIN_REGION_PERCENT && (best_puzzle_goal.cost || i + 1 < puzzles_to_try)) {
+			find_map_regions(&regions, &map);
+			if ((u64)regions.largest * 100 < (u64)regions.num_states * MIN_REGION_PERCENT) {
+				free_map(&map);
+				continue;
+			}
+		}
+		costs = realloc(costs, map.width * map.height * sizeof(*costs));
+		furthest_costs(&map, costs);
+		for (u32 x = 1; x <= w; ++x) {
+			for (u32 y = 1; y <= h; ++y) {
+				struct goal this_goal = { .cost = costs[y*map.width + x] };
 				if (is_better(&this_goal, &best_goal)) {
 					best_goal = this_goal;
 					this_x = x; this_y = y;
 				}
 			}
 		}
+		// only a puzzle that can win needs an actual goal state, and its
+		// shortest path count to settle ties
+		if (best_goal.cost && best_goal.cost >= best_puzzle_goal.cost) {
+			reset_map(&map);
+			track_map_paths(&map);
+			best_goal = get_furthest_point(&map, this_x, this_y);
+		}
 		if (is_better(&best_goal, &best_puzzle_goal)) {
-			best_puzzle      = this_puzzle;
+			snapshot_puzzle(&best_puzzle, &this_puzzle);
 			best_puzzle_goal = best_goal;
 			best_x = this_x; best_y = this_y;
+			chosen = 1;
 		}
-		free(map.data);
+		free_map(&map);
 	}
-	best_puzzle.player.x = w  + 1;
-	best_puzzle.player.y = h + 1;
+	free(costs);
+	free(density);
+	free_map_regions(&regions);
+	free_puzzle(&this_puzzle);
+	if (!chosen) {
+		free_snapshot(&best_puzzle);
+		return 0;
+	}
+	restore_puzzle(puzzle, &best_puzzle);
+	free_snapshot(&best_puzzle);
+	puzzle->player.x = w + 1;
+	puzzle->player.y = h + 1;
 	for (u32 i = 0; i < best_puzzle_goal.p; ++i) {
-		step_puzzle(&best_puzzle, PLAYER_MOVE_PAUSE, NULL);
+		step_puzzle_headless(puzzle);
 	}
-	best_puzzle.player.x = best_puzzle_goal.x - 1;
-	best_puzzle.player.y = best_puzzle_goal.y - 1;
-	best_puzzle.tiles[(best_y - 1) * w + (best_x - 1)] = TILE_GOAL;
-	memcpy(puzzle, &best_puzzle, sizeof(*puzzle));
+	puzzle->player.x = best_puzzle_goal.x - 1;
+	puzzle->player.y = best_puzzle_goal.y - 1;
+	puzzle->tiles[(best_y - 1) * w + (best_x - 1)] = TILE_GOAL;
+	return 1;
 }
 
+// Longer first, then fewer shortest solutions.
 static s32 longer_goal(struct goal *g1, struct goal *g2) {
-	return g1->cost > g2->cost;
+	if (g1->cost != g2->cost) {
+		return g1->cost > g2->cost;
+	}
+	return g1->paths < g2->paths;
 }
 
-void generate_easy_puzzle(struct puzzle *puzzle) {
-	generate(puzzle, longer_goal, 6, 4, 3, 20);
+u32 generate_easy_puzzle(struct puzzle *puzzle) {
+	return generate(puzzle, longer_goal, 6, 4, 3, 20);
 }
 
-void generate_medium_puzzle(struct puzzle *puzzle) {
-	generate(puzzle, longer_goal, 8, 5, 7, 100);
+u32 generate_medium_puzzle(struct puzzle *puzzle) {
+	return generate(puzzle, longer_goal, 8, 5, 7, 100);
 }
 
-void generate_hard_puzzle(struct puzzle *puzzle) {
-	generate(puzzle, longer_goal, 12, 8, 16, 100);
+u32 generate_hard_puzzle(struct puzzle *puzzle) {
+	return generate(puzzle, longer_goal, 12, 8, 16, 100);
 }
@@ -90,8 +90,8 @@ int main(s32 argc, char *argv[]) {
 		}
 	}
 
-	struct menu_state menu_state;
-	struct game_state game_state;
+	struct menu_state menu_state = {};
+	struct game_state game_state = {};
 
 	state = STATE_MENU;
 
@@ -0,0 +1,972 @@
+#define _POSIX_C_SOURCE 200112L
+#include "map.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "my_math.h"
+#include "puzzle.h"
+#include "stencil.h"
+
+// the from plane a bullet marks on the cell it has just moved out of
+static const s32 from_plane[NUM_DIRS] = {
+	FROM_N, -1, FROM_E, -1, FROM_S, -1, FROM_W, -1,
+};
+
+static void set_bit(u64 *plane, u32 i) {
+	plane[i / 64] |= 1ull << (i % 64);
+}
+
+static void set_cost(struct map *map, u32 i, u32 cost) {
+	if (map->cost16) {
+		map->cost16[i] = cost;
+	} else {
+		map->cost32[i] = cost;
+	}
+}
+
+u64 map_states(struct puzzle *puzzle) {
+	u32 page_words = ((puzzle->width + 2) * (puzzle->height + 2) + 63) / 64;
+	return mul_u64(puzzle_period(puzzle), page_words * 64);
+}
+
+static u64 hash_words(u64 *words, u32 n, u64 hash) {
+	for (u32 i = 0; i < n; ++i) {
+		hash = (hash ^ words[i]) * 0x9E3779B97F4A7C15ull;
+		hash ^= hash >> 29;
+	}
+	return hash;
+}
+
+// Whether stored page n holds the same planes as page k, before k is stored.
+static u32 same_page(struct map *map, u32 n, u32 k) {
+	u32 pw = map->page_words;
+	if (memcmp(map->blocked + n*pw, map->blocked + k*pw, pw * sizeof(*map->blocked))) {
+		return 0;
+	}
+	for (u32 f = 0; f < NUM_FROM; ++f) {
+		if (memcmp(map->from[f] + n*pw, map->from[f] + k*pw, pw * sizeof(*map->from[f]))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Sets the bits a ray puts on every page, which must each be stored at their
+// own index: blocked under its bullets and from where they have just left.
+// With only, just on the map cells it marks.
+static void draw_ray(struct map *map, struct emitter *e, struct ray *ray, u8 *only) {
+	u32 w = map->width, pw = map->page_words;
+	s32 stride = dir_dy[ray->dir] * (s32)w + dir_dx[ray->dir];
+	u64 *from = from_plane[ray->dir] < 0 ? NULL : map->from[from_plane[ray->dir]];
+	u32 behind = map_index(map, e->x + 1, e->y + 1, 0);
+	for (u32 m = 1; m <= ray->len; ++m, behind += stride) {
+		u32 on_cell = !only || only[behind + stride];
+		u32 on_behind = from && (!only || only[behind]);
+		if (!on_cell && !on_behind) {
+			continue;
+		}
+		// the bullet on cell m on page k was fired k - (m - 1) ticks on
+		u32 t = (ray->period - (m - 1) % ray->period) % ray->period;
+		for (u32 k = 0, page = 0; k < map->period; ++k, page += pw * 64) {
+			if ((ray->fire_bits >> t) & 1) {
+				if (on_cell) {
+					set_bit(map->blocked, page + behind + stride);
+				}
+				if (on_behind) {
+					set_bit(from, page + behind);
+				}
+			}
+			t = t + 1 == ray->period ? 0 : t + 1;
+		}
+	}
+}
+
+struct map generate_map(struct puzzle *puzzle) {
+	struct map map = {};
+	struct stencil stencil = {};
+	build_stencil(&stencil, puzzle);
+	u64 full_period = stencil_period(&stencil);
+	u32 w = puzzle->width + 2, h = puzzle->height + 2;
+	map.page_words = (w * h + 63) / 64;
+	if (mul_u64(full_period, map.page_words * 64) > MAP_MAX_STATES) {
+		map.page_words = 0;
+		free_stencil(&stencil);
+		return map;
+	}
+	u32 period = full_period;
+	map.width = w; map.height = h; map.period = period;
+	map.size = period * map.page_words * 64;
+	u32 pw = map.page_words, words = period * pw;
+	map.page = malloc(period * sizeof(*map.page));
+	map.blocked = calloc(words, sizeof(*map.blocked));
+	for (u32 f = 0; f < NUM_FROM; ++f) {
+		map.from[f] = calloc(words, sizeof(*map.from[f]));
+	}
+	// every cost fits below the number of states, plus one for the start
+	if (map.size < 0xFFFF) {
+		map.cost16 = calloc(map.size, sizeof(*map.cost16));
+	} else {
+		map.cost32 = calloc(map.size, sizeof(*map.cost32));
+	}
+	// page 0 gets the border, emitters, walls and padding, the rest copy it
+	for (u32 j = 0; j < h; ++j) {
+		for (u32 i = 0; i < w; ++i) {
+			u32 blocked = 1;
+			if (i != 0 && j != 0 && i != w-1 && j != h-1) {
+				enum tile tile = puzzle->tiles[(j - 1)*(w - 2) + (i - 1)];
+				blocked = tile == TILE_EMITTER || tile == TILE_WALL;
+			}
+			if (blocked) {
+				set_bit(map.blocked, j*w + i);
+			}
+		}
+	}
+	for (u32 i = w * h; i < pw * 64; ++i) {
+		set_bit(map.blocked, i);
+	}
+	for (u32 k = 1; k < period; ++k) {
+		memcpy(map.blocked + k*pw, map.blocked, pw * sizeof(*map.blocked));
+	}
+	for (u32 r = 0; r < stencil.num_rays; ++r) {
+		struct ray *ray = &stencil.rays[r];
+		draw_ray(&map, &puzzle->emitters[ray->emitter], ray, NULL);
+	}
+	// keep each page only if no earlier one matches it, moving it down to
+	// the next free slot; table holds stored page numbers by hash
+	u32 slots = 16;
+	while (slots < 2 * period) {
+		slots *= 2;
+	}
+	u32 *table = malloc(slots * sizeof(*table));
+	memset(table, 0xFF, slots * sizeof(*table));
+	for (u32 k = 0; k < period; ++k) {
+		u64 hash = hash_words(map.blocked + k*pw, pw, 0);
+		for (u32 f = 0; f < NUM_FROM; ++f) {
+			hash = hash_words(map.from[f] + k*pw, pw, hash);
+		}
+		u32 j = hash & (slots - 1);
+		while (table[j] != ~0u && !same_page(&map, table[j], k)) {
+			j = (j + 1) & (slots - 1);
+		}
+		if (table[j] == ~0u) {
+			u32 n = table[j] = map.num_pages++;
+			if (n != k) {
+				memcpy(map.blocked + n*pw, map.blocked + k*pw, pw * sizeof(*map.blocked));
+				for (u32 f = 0; f < NUM_FROM; ++f) {
+					memcpy(map.from[f] + n*pw, map.from[f] + k*pw, pw * sizeof(*map.from[f]));
+				}
+			}
+		}
+		map.page[k] = table[j];
+	}
+	map.blocked = realloc(map.blocked, map.num_pages * pw * sizeof(*map.blocked));
+	for (u32 f = 0; f < NUM_FROM; ++f) {
+		map.from[f] = realloc(map.from[f], map.num_pages * pw * sizeof(*map.from[f]));
+	}
+	free(table);
+	free_stencil(&stencil);
+	return map;
+}
+
+// Gives every page its own copy of the planes again, for editing in place.
+static void unshare_pages(struct map *map) {
+	u32 pw = map->page_words, words = map->period * pw;
+	if (map->num_pages == map->period) {
+		return;
+	}
+	u64 *blocked = malloc(words * sizeof(*blocked));
+	for (u32 p = 0; p < map->period; ++p) {
+		memcpy(blocked + p*pw, map_plane(map, map->blocked, p), pw * sizeof(*blocked));
+	}
+	free(map->blocked);
+	map->blocked = blocked;
+	for (u32 f = 0; f < NUM_FROM; ++f) {
+		u64 *from = malloc(words * sizeof(*from));
+		for (u32 p = 0; p < map->period; ++p) {
+			memcpy(from + p*pw, map_plane(map, map->from[f], p), pw * sizeof(*from));
+		}
+		free(map->from[f]);
+		map->from[f] = from;
+	}
+	for (u32 p = 0; p < map->period; ++p) {
+		map->page[p] = p;
+	}
+	map->num_pages = map->period;
+}
+
+void remove_map_emitter(struct map *map, struct puzzle *puzzle, u32 i) {
+	struct emitter *e = &puzzle->emitters[i];
+	u32 w = map->width, pw = map->page_words;
+	struct stencil stencil = {};
+	build_stencil(&stencil, puzzle);
+	unshare_pages(map);
+	// the emitter's cells and its own, which only its rays mark as just left
+	u32 home = map_index(map, e->x + 1, e->y + 1, 0);
+	u8 *only = calloc(pw * 64, 1);
+	only[home] = 1;
+	for (u32 r = 0; r < stencil.num_rays; ++r) {
+		struct ray *ray = &stencil.rays[r];
+		if (ray->emitter != i) {
+			continue;
+		}
+		for (u32 m = 0; m < ray->len; ++m) {
+			u32 c = stencil.cells[ray->first + m];
+			only[(c / puzzle->width + 1)*w + c % puzzle->width + 1] = 1;
+		}
+	}
+	// clear them, then let the other rays draw on them again
+	for (u32 c = 0; c < w * map->height; ++c) {
+		if (!only[c]) {
+			continue;
+		}
+		u64 bit = 1ull << (c % 64);
+		for (u32 p = 0; p < map->period; ++p) {
+			u32 word = p*pw + c / 64;
+			if (c != home) {
+				map->blocked[word] &= ~bit;
+			}
+			for (u32 f = 0; f < NUM_FROM; ++f) {
+				map->from[f][word] &= ~bit;
+			}
+		}
+	}
+	for (u32 r = 0; r < stencil.num_rays; ++r) {
+		struct ray *ray = &stencil.rays[r];
+		if (ray->emitter != i) {
+			draw_ray(map, &puzzle->emitters[ray->emitter], ray, only);
+		}
+	}
+	free(only);
+	free_stencil(&stencil);
+}
+
+u32 add_map_emitter(struct map *map, struct puzzle *puzzle, u32 i) {
+	struct stencil stencil = {};
+	build_emitter_stencil(&stencil, puzzle, i);
+	u32 fits = 1;
+	for (u32 r = 0; r < stencil.num_rays; ++r) {
+		if (stencil.rays[r].len && map->period % stencil.rays[r].period) {
+			fits = 0;
+		}
+	}
+	if (fits) {
+		unshare_pages(map);
+		for (u32 r = 0; r < stencil.num_rays; ++r) {
+			draw_ray(map, &puzzle->emitters[i], &stencil.rays[r], NULL);
+		}
+	}
+	free_stencil(&stencil);
+	return fits;
+}
+
+void print_map_page(FILE *out, struct map *map, u32 page) {
+	u32 w = map->width, h = map->height;
+	for (u32 j = 0; j < h; ++j) {
+		for (u32 i = 0; i < w; ++i) {
+			u32 c = map_index(map, i, j, page);
+			u32 v = map_cost(map, c);
+			u32 blocked = map_plane_bit(map, map->blocked, c);
+			v |= blocked << 24;
+			for (u32 f = 0; f < NUM_FROM; ++f) {
+				v |= map_plane_bit(map, map->from[f], c) << (28 + f);
+			}
+			fprintf(out, "%c:%08X    ", blocked ? '#' : '.', v);
+		}
+		fprintf(out, "\n");
+	}
+}
+
+void reset_map(struct map *map) {
+	if (map->cost16) {
+		memset(map->cost16, 0, map->size * sizeof(*map->cost16));
+	} else {
+		memset(map->cost32, 0, map->size * sizeof(*map->cost32));
+	}
+	if (map->paths) {
+		memset(map->paths, 0, map->size * sizeof(*map->paths));
+	}
+}
+
+void track_map_paths(struct map *map) {
+	if (!map->paths) {
+		map->paths = calloc(map->size, sizeof(*map->paths));
+	}
+}
+
+void drop_map_paths(struct map *map) {
+	free(map->paths);
+	map->paths = NULL;
+}
+
+void free_map(struct map *map) {
+	free(map->page);
+	free(map->blocked);
+	for (u32 f = 0; f < NUM_FROM; ++f) {
+		free(map->from[f]);
+	}
+	free(map->cost16);
+	free(map->cost32);
+	free(map->paths);
+	memset(map, 0, sizeof(*map));
+}
+
+// dst |= (src & ~mask) moved shift bits towards higher indices, or towards
+// lower ones for a negative shift. Bits moved off either end are dropped.
+static void or_shifted(u64 *dst, u64 *src, u64 *mask, u32 words, s32 shift) {
+	u32 q = (shift < 0 ? -shift : shift) / 64, r = (shift < 0 ? -shift : shift) % 64;
+	if (q >= words) {
+		return;
+	}
+	u32 n = words - q;
+	if (shift >= 0) {
+		dst += q;
+		dst[0] |= (src[0] & ~mask[0]) << r;
+		for (u32 i = 1; i < n; ++i) {
+			u64 lo = src[i - 1] & ~mask[i - 1], hi = src[i] & ~mask[i];
+			dst[i] |= r ? hi << r | lo >> (64 - r) : hi;
+		}
+	} else {
+		src += q; mask += q;
+		for (u32 i = 0; i + 1 < n; ++i) {
+			u64 lo = src[i] & ~mask[i], hi = src[i + 1] & ~mask[i + 1];
+			dst[i] |= r ? lo >> r | hi << (64 - r) : lo;
+		}
+		dst[n - 1] |= (src[n - 1] & ~mask[n - 1]) >> r;
+	}
+}
+
+// the words [lo, hi) of a page that may hold frontier bits
+struct span {
+	u32 lo, hi;
+};
+
+// One reverse BFS shared by its workers. Each worker owns a contiguous run of
+// pages and builds their next layer from the page one tick later, so the only
+// shared state a worker writes is its own pages and its slot in counts.
+struct bfs {
+	struct map *map;
+	u64 *seen;
+	u64 *layer[2];
+	struct span *span[2];
+	u32 num_workers;
+	u32 *counts;  // per worker, for even and odd layers
+	pthread_barrier_t *barrier;
+	u32 layers, count;  // last non-empty layer and its size
+};
+
+// Threads kept for a run of searches over one map, so a caller searching
+// from every cell doesn't start and join them each time. Between searches
+// the workers wait on barrier for the next bfs, or for stop.
+struct bfs_pool {
+	u32 num_workers;  // the threads that started, plus the caller
+	pthread_mutex_t lock;
+	pthread_cond_t  ready;
+	u32 started, stop;
+	pthread_barrier_t barrier;
+	struct bfs *bfs;
+	struct bfs_worker {
+		struct bfs_pool *pool;
+		u32 id;
+		pthread_t thread;
+	} workers[MAP_THREADS];
+};
+
+// The shortest paths from a state newly reached one tick before t: the sum
+// over its moves that land on the current layer, which is where they were
+// found from, so t's neighbours there already have their counts.
+static u64 count_paths(struct map *map, u64 *cur, u32 t) {
+	u32 w = map->width;
+	// pause, N, E, S and W, and the from plane that forbids each move
+	u32 to[5] = { t, t - w, t + 1, t + w, t - 1 };
+	s32 plane[5] = { -1, FROM_S, FROM_W, FROM_N, FROM_E };
+	u64 total = 0;
+	for (u32 k = 0; k < 5; ++k) {
+		if (!map_bit(cur, to[k])
+		 || (plane[k] >= 0 && map_plane_bit(map, map->from[plane[k]], to[k]))) {
+			continue;
+		}
+		u64 sum = total + map->paths[to[k]];
+		total = sum < total ? ~0ull : sum;
+	}
+	return total;
+}
+
+// Builds layer + 1 on pages [first, last) from layer on the pages after them.
+static u32 expand_pages(struct bfs *bfs, u32 layer, u32 first, u32 last) {
+	struct map *map = bfs->map;
+	u32 w = map->width, period = map->period, pw = map->page_words;
+	// a move shifts by at most a row, so the next frontier is within a row's
+	// words of the current one
+	u32 reach = w / 64 + 1;
+	u64 *cur = bfs->layer[layer & 1], *next = bfs->layer[(layer + 1) & 1];
+	struct span *cur_span = bfs->span[layer & 1], *next_span = bfs->span[(layer + 1) & 1];
+	u64 **from = map->from;
+	u32 count = 0;
+	for (u32 np = first; np < last; ++np) {
+		u32 p = np + 1 == period ? 0 : np + 1;
+		u64 *n = next + np*pw;
+		// clear what this page held two layers ago
+		if (next_span[np].lo < next_span[np].hi) {
+			memset(n + next_span[np].lo, 0,
+			       (next_span[np].hi - next_span[np].lo) * sizeof(*n));
+		}
+		next_span[np] = (struct span) { pw, 0 };
+		if (cur_span[p].lo >= cur_span[p].hi) {
+			continue;
+		}
+		u32 lo = cur_span[p].lo > reach ? cur_span[p].lo - reach : 0;
+		u32 hi = MIN(cur_span[p].hi + reach, pw);
+		u64 *f = cur + p*pw;
+		u32 off = map->page[p]*pw + lo;
+		for (u32 i = lo; i < hi; ++i) {
+			n[i] = f[i];
+		}
+		or_shifted(n + lo, f + lo, from[FROM_S] + off, hi - lo,  (s32)w);
+		or_shifted(n + lo, f + lo, from[FROM_W] + off, hi - lo, -1);
+		or_shifted(n + lo, f + lo, from[FROM_N] + off, hi - lo, -(s32)w);
+		or_shifted(n + lo, f + lo, from[FROM_E] + off, hi - lo,  1);
+		u32 new_lo = pw, new_hi = 0;
+		for (u32 i = lo; i < hi; ++i) {
+			u64 bits = n[i] & ~bfs->seen[np*pw + i];
+			n[i] = bits;
+			bfs->seen[np*pw + i] |= bits;
+			if (bits) {
+				new_lo = MIN(new_lo, i);
+				new_hi = i + 1;
+			}
+			for (; bits; bits &= bits - 1) {
+				u32 c = (np*pw + i)*64 + __builtin_ctzll(bits);
+				set_cost(map, c, layer + 2);
+				if (map->paths) {
+					map->paths[c] = count_paths(map, cur, c - np*pw*64 + p*pw*64);
+				}
+				++count;
+			}
+		}
+		// the rest of the window was zeroed by the mask
+		next_span[np] = (struct span) { new_lo, new_hi };
+	}
+	return count;
+}
+
+// Runs layers until one comes up empty. Every worker sums the same counts in
+// the same order, so all of them agree on when to stop.
+static void run_layers(struct bfs *bfs, u32 id) {
+	u32 period = bfs->map->period, n = bfs->num_workers;
+	u32 first = id * period / n, last = (id + 1) * period / n;
+	for (u32 layer = 0; ; ++layer) {
+		u32 *counts = bfs->counts + ((layer + 1) & 1) * n;
+		counts[id] = expand_pages(bfs, layer, first, last);
+		if (n > 1) {
+			pthread_barrier_wait(bfs->barrier);
+		}
+		u32 total = 0;
+		for (u32 i = 0; i < n; ++i) {
+			total += counts[i];
+		}
+		if (!total) {
+			if (id == 0) {
+				bfs->layers = layer;
+			}
+			return;
+		}
+		if (id == 0) {
+			bfs->count = total;
+		}
+	}
+}
+
+static void *bfs_thread(void *arg) {
+	struct bfs_worker *worker = arg;
+	struct bfs_pool *pool = worker->pool;
+	// the barrier is only set up once the pool knows how many threads started
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->started) {
+		pthread_cond_wait(&pool->ready, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	for (;;) {
+		pthread_barrier_wait(&pool->barrier);
+		if (pool->stop) {
+			return NULL;
+		}
+		run_layers(pool->bfs, worker->id);
+		pthread_barrier_wait(&pool->barrier);
+	}
+}
+
+// How many workers a BFS over map gets: one below MAP_PARALLEL_STATES, else
+// up to MAP_THREADS but no more than there are cores or pages.
+static u32 bfs_workers(struct map *map) {
+	if (map->size < MAP_PARALLEL_STATES) {
+		return 1;
+	}
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	u32 n = MIN(MAP_THREADS, map->period);
+	if (cores > 0 && (u32)cores < n) {
+		n = cores;
+	}
+	return MAX(n, 1);
+}
+
+// Starts bfs_workers(map) - 1 threads, or as many of them as will start.
+static void start_pool(struct bfs_pool *pool, struct map *map) {
+	u32 wanted = bfs_workers(map);
+	memset(pool, 0, sizeof(*pool));
+	pool->num_workers = 1;
+	if (wanted == 1) {
+		return;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->ready, NULL);
+	pthread_mutex_lock(&pool->lock);
+	for (u32 i = 1; i < wanted; ++i) {
+		struct bfs_worker *worker = &pool->workers[pool->num_workers];
+		*worker = (struct bfs_worker) { .pool = pool, .id = pool->num_workers };
+		if (pthread_create(&worker->thread, NULL, bfs_thread, worker)) {
+			break;
+		}
+		++pool->num_workers;
+	}
+	pthread_barrier_init(&pool->barrier, NULL, pool->num_workers);
+	pool->started = 1;
+	pthread_cond_broadcast(&pool->ready);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void stop_pool(struct bfs_pool *pool) {
+	if (!pool->started) {
+		return;
+	}
+	pool->stop = 1;
+	pthread_barrier_wait(&pool->barrier);
+	for (u32 i = 1; i < pool->num_workers; ++i) {
+		pthread_join(pool->workers[i].thread, NULL);
+	}
+	pthread_barrier_destroy(&pool->barrier);
+	pthread_cond_destroy(&pool->ready);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+// Reverse BFS from (x, y), one layer at a time. Each page keeps its frontier
+// as a bitset; the states one tick earlier that step into it are a pause, or
+// a move N, E, S or W from the cell on the opposite side, provided no bullet
+// is leaving the frontier cell towards it. Large maps split the pages between
+// the pool's threads; the costs don't depend on how many. Leaves the last
+// layer in bfs for the caller, which frees it with free_bfs.
+static void search(struct bfs *bfs, struct map *map, u32 x, u32 y, struct bfs_pool *pool) {
+	u32 period = map->period, pw = map->page_words;
+	u32 words = period * pw;
+	bfs->map = map;
+	bfs->num_workers = pool->num_workers;
+	bfs->barrier = &pool->barrier;
+	bfs->seen     = malloc(words * sizeof(*bfs->seen));
+	bfs->layer[0] = calloc(words, sizeof(*bfs->layer[0]));
+	bfs->layer[1] = calloc(words, sizeof(*bfs->layer[1]));
+	bfs->span[0]  = malloc(period * sizeof(*bfs->span[0]));
+	bfs->span[1]  = malloc(period * sizeof(*bfs->span[1]));
+	bfs->counts   = calloc(2 * bfs->num_workers, sizeof(*bfs->counts));
+	for (u32 p = 0; p < period; ++p) {
+		memcpy(bfs->seen + p*pw, map_plane(map, map->blocked, p), pw * sizeof(*bfs->seen));
+	}
+	for (u32 i = 0; i < period; ++i) {
+		u32 c = map_index(map, x, y, i);
+		bfs->span[0][i] = (struct span) { pw, 0 };
+		bfs->span[1][i] = (struct span) { pw, 0 };
+		if (!map_bit(bfs->seen, c)) {
+			set_bit(bfs->seen, c);
+			set_bit(bfs->layer[0], c);
+			set_cost(map, c, 1);
+			if (map->paths) {
+				map->paths[c] = 1;
+			}
+			bfs->span[0][i] = (struct span) { c / 64 - i*pw, c / 64 - i*pw + 1 };
+			++bfs->count;
+		}
+	}
+	if (!bfs->count) {
+		return;
+	}
+	if (bfs->num_workers == 1) {
+		run_layers(bfs, 0);
+		return;
+	}
+	pool->bfs = bfs;
+	pthread_barrier_wait(&pool->barrier);
+	run_layers(bfs, 0);
+	// nobody may still be reading counts when the next search resets them
+	pthread_barrier_wait(&pool->barrier);
+}
+
+static void free_bfs(struct bfs *bfs) {
+	free(bfs->seen);
+	free(bfs->layer[0]);
+	free(bfs->layer[1]);
+	free(bfs->span[0]);
+	free(bfs->span[1]);
+	free(bfs->counts);
+}
+
+static u32 pooled_costs(struct map *map, u32 x, u32 y, struct bfs_pool *pool) {
+	struct bfs bfs = {};
+	search(&bfs, map, x, y, pool);
+	u32 cost = bfs.count ? bfs.layers + 1 : 0;
+	free_bfs(&bfs);
+	return cost;
+}
+
+u32 fill_map_costs(struct map *map, u32 x, u32 y) {
+	struct bfs_pool pool;
+	start_pool(&pool, map);
+	u32 cost = pooled_costs(map, x, y, &pool);
+	stop_pool(&pool);
+	return cost;
+}
+
+// The goal is a random state of the last layer, in index order.
+struct goal get_furthest_point(struct map *map, u32 x, u32 y) {
+	u32 w = map->width, pw = map->page_words;
+	struct bfs bfs = {};
+	struct bfs_pool pool;
+	start_pool(&pool, map);
+	search(&bfs, map, x, y, &pool);
+	stop_pool(&pool);
+	struct goal result = {
+		.x = 0, .y = 0, .p = 0, .cost = 0, .others = 1000,
+	};
+	if (bfs.count) {
+		u64 *last = bfs.layer[bfs.layers & 1];
+		u32 choice = rand() % bfs.count;
+		u32 i = 0;
+		for (; choice >= (u32)__builtin_popcountll(last[i]); ++i) {
+			choice -= __builtin_popcountll(last[i]);
+		}
+		u64 bits = last[i];
+		for (; choice; --choice) {
+			bits &= bits - 1;
+		}
+		u32 c = i*64 + __builtin_ctzll(bits);
+		u32 cell = c % (pw * 64);
+		result = (struct goal) {
+			.x = cell % w, .y = cell / w,
+			.p = c / (pw * 64), .cost = bfs.layers + 1,
+			.others = -bfs.count,
+			.paths = map->paths ? map->paths[c] : 0,
+		};
+	}
+	free_bfs(&bfs);
+	return result;
+}
+
+// all ones when the state's from flag f is clear, so a move into it is allowed
+static inline u64 open_from(u8 flags, u32 f) {
+	return -(u64)!((flags >> (f + 1)) & 1);
+}
+
+// furthest_costs one BFS per cell, sharing one pool of workers.
+static void furthest_costs_slow(struct map *map, u32 *costs) {
+	u32 w = map->width, h = map->height;
+	struct bfs_pool pool;
+	start_pool(&pool, map);
+	memset(costs, 0, w * h * sizeof(*costs));
+	for (u32 y = 1; y + 1 < h; ++y) {
+		for (u32 x = 1; x + 1 < w; ++x) {
+			reset_map(map);
+			costs[y*w + x] = pooled_costs(map, x, y, &pool);
+		}
+	}
+	stop_pool(&pool);
+}
+
+// get_furthest_point's cost for every start cell at once, without picking
+// goals: costs[y*width + x] gets the cost of the last layer reached from
+// (x, y), or 0 when it is blocked. The reverse BFS runs 64 starts at a time,
+// with a u64 per state holding one bit per start that has reached it.
+void furthest_costs(struct map *map, u32 *costs) {
+	u32 w = map->width, period = map->period;
+	u32 page = map->page_words * 64, cells = w * map->height;
+	if (map->size > FURTHEST_MAX_STATES) {
+		furthest_costs_slow(map, costs);
+		return;
+	}
+	// bit 0 blocked, bit f + 1 from[f], one byte per state
+	u8 *flags = malloc(map->size);
+	u64 *seen = malloc(map->size * sizeof(*seen));
+	u64 *cur  = malloc(map->size * sizeof(*cur));
+	u64 *next = malloc(map->size * sizeof(*next));
+	// which pages of cur and next hold any bits
+	u8 *cur_live  = malloc(period);
+	u8 *next_live = malloc(period);
+	// only cells open on some page get a lane
+	u32 *starts = malloc(cells * sizeof(*starts)), num_starts = 0;
+	if (!flags || !seen || !cur || !next || !cur_live || !next_live || !starts) {
+		furthest_costs_slow(map, costs);
+		goto done;
+	}
+	for (u32 p = 0; p < period; ++p) {
+		u64 *blocked = map_plane(map, map->blocked, p);
+		for (u32 i = 0; i < page; ++i) {
+			flags[p*page + i] = map_bit(blocked, i);
+			for (u32 f = 0; f < NUM_FROM; ++f) {
+				flags[p*page + i] |= map_bit(map_plane(map, map->from[f], p), i) << (f + 1);
+			}
+		}
+	}
+	for (u32 c = 0; c < cells; ++c) {
+		for (u32 p = 0; p < period; ++p) {
+			if (!(flags[p*page + c] & 1)) {
+				starts[num_starts++] = c;
+				break;
+			}
+		}
+	}
+	memset(costs, 0, cells * sizeof(*costs));
+	for (u32 first = 0; first < num_starts; first += 64) {
+		u32 lanes = MIN(num_starts - first, 64);
+		memset(cur, 0, map->size * sizeof(*cur));
+		memset(next, 0, map->size * sizeof(*next));
+		u64 alive = 0;
+		for (u32 l = 0; l < lanes; ++l) {
+			for (u32 p = 0; p < period; ++p) {
+				u32 s = p*page + starts[first + l];
+				if (!(flags[s] & 1)) {
+					cur[s] |= 1ull << l;
+					alive |= 1ull << l;
+				}
+			}
+		}
+		memcpy(seen, cur, map->size * sizeof(*seen));
+		memset(cur_live, 1, period);
+		memset(next_live, 0, period);
+		for (u32 cost = 1; alive; ++cost) {
+			for (u64 bits = alive; bits; bits &= bits - 1) {
+				costs[starts[first + __builtin_ctzll(bits)]] = cost;
+			}
+			alive = 0;
+			// states one tick earlier: a pause, or a move into a neighbour
+			// that no bullet is leaving towards the mover
+			for (u32 p = 0; p < period; ++p) {
+				u32 np = p ? p - 1 : period - 1;
+				u64 *f = cur + p*page, *n = next + np*page, *sn = seen + np*page;
+				u8 *fl = flags + p*page, *nfl = flags + np*page;
+				if (!cur_live[p]) {
+					// an empty page only has to clear what it last produced
+					if (next_live[np]) {
+						memset(n, 0, cells * sizeof(*n));
+						next_live[np] = 0;
+					}
+					continue;
+				}
+				u64 page_alive = 0;
+				for (u32 c = w + 1; c < cells - w - 1; ++c) {
+					if (nfl[c] & 1) {
+						continue;
+					}
+					u64 v = f[c]
+					      | (f[c - w] & open_from(fl[c - w], FROM_S))
+					      | (f[c + 1] & open_from(fl[c + 1], FROM_W))
+					      | (f[c + w] & open_from(fl[c + w], FROM_N))
+					      | (f[c - 1] & open_from(fl[c - 1], FROM_E));
+					v &= ~sn[c];
+					n[c] = v;
+					sn[c] |= v;
+					page_alive |= v;
+				}
+				next_live[np] = page_alive != 0;
+				alive |= page_alive;
+			}
+			u64 *tmp = cur; cur = next; next = tmp;
+			u8 *tmp_live = cur_live; cur_live = next_live; next_live = tmp_live;
+		}
+	}
+done:
+	free(flags);
+	free(seen);
+	free(cur);
+	free(next);
+	free(cur_live);
+	free(next_live);
+	free(starts);
+}
+
+// A move from page p lands on page p + 1. It is legal when the target isn't
+// blocked and no bullet is leaving the target towards the player, which is
+// what the BFS checked on its way out, so any step that lowers the cost by
+// one is safe.
+struct hint map_hint(struct map *map, u32 x, u32 y, u32 p) {
+	static const struct {
+		enum player_move move;
+		s32 dx, dy;
+		s32 from;  // the from plane that forbids the move, -1 for none
+	} steps[] = {
+		{ PLAYER_MOVE_PAUSE,  0,  0, -1     },
+		{ PLAYER_MOVE_N,      0, -1, FROM_S },
+		{ PLAYER_MOVE_E,      1,  0, FROM_W },
+		{ PLAYER_MOVE_S,      0,  1, FROM_N },
+		{ PLAYER_MOVE_W,     -1,  0, FROM_E },
+	};
+	struct hint hint = {
+		.reachable = 0, .moves_left = 0, .next = PLAYER_MOVE_PAUSE,
+	};
+	if (!map->period) {
+		return hint;
+	}
+	u32 cost = map_cost(map, map_index(map, x + 1, y + 1, p % map->period));
+	if (!cost) {
+		return hint;
+	}
+	hint.reachable = 1;
+	hint.moves_left = cost - 1;
+	u32 np = (p + 1) % map->period;
+	for (u32 k = 0; cost > 1 && k < sizeof(steps) / sizeof(steps[0]); ++k) {
+		u32 c = map_index(map, x + 1 + steps[k].dx, y + 1 + steps[k].dy, np);
+		if (steps[k].from >= 0 && map_plane_bit(map, map->from[steps[k].from], c)) {
+			continue;
+		}
+		if (map_cost(map, c) == cost - 1) {
+			hint.next = steps[k].move;
+			break;
+		}
+	}
+	return hint;
+}
+
+// Fills to with the states one tick after s: pause, then N, E, S and W.
+// Returns a mask of the ones the player can move to, as in the BFS but
+// forwards.
+static u32 successors(struct map *map, u32 s, u32 to[5]) {
+	static const s32 plane[5] = { -1, FROM_S, FROM_W, FROM_N, FROM_E };
+	u32 page = map->page_words * 64, w = map->width;
+	u32 p = s / page, c = s - p*page;
+	u32 t = (p + 1 == map->period ? 0 : p + 1) * page + c;
+	to[0] = t; to[1] = t - w; to[2] = t + 1; to[3] = t + w; to[4] = t - 1;
+	u32 mask = 0;
+	for (u32 k = 0; k < 5; ++k) {
+		if (!map_plane_bit(map, map->blocked, to[k])
+		 && (plane[k] < 0 || !map_plane_bit(map, map->from[plane[k]], to[k]))) {
+			mask |= 1 << k;
+		}
+	}
+	return mask;
+}
+
+// Tarjan's algorithm with an explicit stack, since the graph can have
+// millions of states. Regions come out sinks first.
+void find_map_regions(struct map_regions *regions, struct map *map) {
+	u32 size = map->size;
+	u32 *order = calloc(size, sizeof(*order));  // visit order + 1, 0 if not yet
+	u32 *low   = malloc(size * sizeof(*low));
+	u32 *stack = malloc(size * sizeof(*stack));
+	// the DFS path: each state and the successors it has yet to try
+	struct frame {
+		u32 s, left;
+	} *calls = malloc(size * sizeof(*calls));
+	u32 visited = 0, stack_len = 0;
+	regions->num_regions = 0;
+	regions->region = realloc(regions->region, size * sizeof(*regions->region));
+	regions->sizes  = realloc(regions->sizes, size * sizeof(*regions->sizes));
+	memset(regions->region, 0xFF, size * sizeof(*regions->region));
+	for (u32 root = 0; root < size; ++root) {
+		if (map_plane_bit(map, map->blocked, root) || order[root]) {
+			continue;
+		}
+		u32 depth = 0, enter = root;
+		for (;;) {
+			if (enter != ~0u) {
+				u32 to[5];
+				calls[depth++] = (struct frame) { enter, successors(map, enter, to) };
+				order[enter] = low[enter] = ++visited;
+				stack[stack_len++] = enter;
+				enter = ~0u;
+			}
+			if (!depth) {
+				break;
+			}
+			struct frame *f = &calls[depth - 1];
+			if (f->left) {
+				u32 to[5];
+				successors(map, f->s, to);
+				u32 t = to[__builtin_ctz(f->left)];
+				f->left &= f->left - 1;
+				if (!order[t]) {
+					enter = t;
+				} else if (regions->region[t] == ~0u) {
+					low[f->s] = MIN(low[f->s], order[t]);
+				}
+				continue;
+			}
+			// f->s is done: close its region if it is the root of one
+			if (low[f->s] == order[f->s]) {
+				u32 r = regions->num_regions++, n = 0, t;
+				do {
+					t = stack[--stack_len];
+					regions->region[t] = r;
+					++n;
+				} while (t != f->s);
+				regions->sizes[r] = n;
+			}
+			--depth;
+			if (depth) {
+				u32 parent = calls[depth - 1].s;
+				low[parent] = MIN(low[parent], low[f->s]);
+			}
+		}
+	}
+	// a region is a sink if none of its edges leave it
+	u8 *leaves = calloc(regions->num_regions, 1);
+	for (u32 s = 0; s < size; ++s) {
+		u32 to[5];
+		if (regions->region[s] == ~0u) {
+			continue;
+		}
+		for (u32 mask = successors(map, s, to); mask; mask &= mask - 1) {
+			if (regions->region[to[__builtin_ctz(mask)]] != regions->region[s]) {
+				leaves[regions->region[s]] = 1;
+			}
+		}
+	}
+	regions->largest = 0;
+	regions->num_states = 0;
+	regions->num_sinks = 0;
+	regions->sink_states = 0;
+	for (u32 r = 0; r < regions->num_regions; ++r) {
+		regions->largest = MAX(regions->largest, regions->sizes[r]);
+		regions->num_states += regions->sizes[r];
+		if (!leaves[r]) {
+			++regions->num_sinks;
+			regions->sink_states += regions->sizes[r];
+		}
+	}
+	free(leaves);
+	free(order);
+	free(low);
+	free(stack);
+	free(calls);
+}
+
+void free_map_regions(struct map_regions *regions) {
+	free(regions->region);
+	free(regions->sizes);
+	memset(regions, 0, sizeof(*regions));
+}
+
+u32 cells_share_region(struct map_regions *regions, struct map *map,
+                       u32 x0, u32 y0, u32 x1, u32 y1) {
+	for (u32 p = 0; p < map->period; ++p) {
+		u32 r = regions->region[map_index(map, x0, y0, p)];
+		if (r == ~0u) {
+			continue;
+		}
+		for (u32 q = 0; q < map->period; ++q) {
+			if (regions->region[map_index(map, x1, y1, q)] == r) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
@@ -43,7 +43,7 @@ static struct menu_widget menu_widget = {
 void init_menu_state(struct menu_state *menu_state) {
 	menu_state->last_frame_time = SDL_GetTicks();
 	menu_state->anim_ticks = 0;
-	menu_state->puzzle     = generate_puzzle(BG_PUZZLE_W, BG_PUZZLE_H, BG_PUZZLE_E);
+	generate_puzzle(&menu_state->puzzle, BG_PUZZLE_W, BG_PUZZLE_H, BG_PUZZLE_E);
 	menu_state->target_tex = SDL_CreateTexture(menu_state->renderer, SDL_PIXELFORMAT_RGBA32,
                                                    SDL_TEXTUREACCESS_TARGET,
                                                    TW * BG_PUZZLE_W, TH * BG_PUZZLE_H);
@@ -58,19 +58,25 @@ void run_menu(struct menu_state *menu_state) {
 		case MENU_WIDGET_QUIT:
 			goto quit;
 		case MENU_ITEM_GENERATE_1:
-			generate_easy_puzzle(&menu_state->game_state->puzzle);
+			if (!generate_easy_puzzle(&menu_state->game_state->puzzle)) {
+				continue;
+			}
 			init_game_state(menu_state->game_state);
 			menu_state->menu_item = 0;
 			state = STATE_GAME;
 			return;
 		case MENU_ITEM_GENERATE_2:
-			generate_medium_puzzle(&menu_state->game_state->puzzle);
+			if (!generate_medium_puzzle(&menu_state->game_state->puzzle)) {
+				continue;
+			}
 			init_game_state(menu_state->game_state);
 			menu_state->menu_item = 0;
 			state = STATE_GAME;
 			return;
 		case MENU_ITEM_GENERATE_3:
-			generate_hard_puzzle(&menu_state->game_state->puzzle);
+			if (!generate_hard_puzzle(&menu_state->game_state->puzzle)) {
+				continue;
+			}
 			init_game_state(menu_state->game_state);
 			menu_state->menu_item = 0;
 			state = STATE_GAME;
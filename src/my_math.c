@@ -16,5 +16,31 @@ u32 hcf_u32(u32 a, u32 b) {
 }
 
 u32 lcm_u32(u32 a, u32 b) {
-	return a * b / hcf_u32(a, b);
+	return a / hcf_u32(a, b) * b;
+}
+
+u64 hcf_u64(u64 a, u64 b) {
+	if (b > a) {
+		u64 tmp = b; b = a; a = tmp;
+	}
+	while (b) {
+		a %= b;
+		u64 tmp = b; b = a; a = tmp;
+	}
+	return a;
+}
+
+u64 lcm_u64(u64 a, u64 b) {
+	u64 a_part = a / hcf_u64(a, b);
+	if (b && a_part > ~0ull / b) {
+		return ~0ull;
+	}
+	return a_part * b;
+}
+
+u64 mul_u64(u64 a, u64 b) {
+	if (b && a > ~0ull / b) {
+		return ~0ull;
+	}
+	return a * b;
 }
@@ -1,5 +1,6 @@
 #include "puzzle.h"
 
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,9 @@
 #include "types.h"
 #include "my_math.h"
 #include "anim.h"
+#include "stencil.h"
+#include "map.h"
+#include "search.h"
 
 static void step_coords(u32 *x, u32 *y, enum direction dir) {
 	switch (dir) {
@@ -37,6 +41,78 @@ static void step_coords(u32 *x, u32 *y, enum direction dir) {
 	}
 }
 
+const s32 dir_dx[NUM_DIRS] = {  0,  1, 1, 1, 0, -1, -1, -1 };
+const s32 dir_dy[NUM_DIRS] = { -1, -1, 0, 1, 1,  1,  0, -1 };
+
+// indexed by (dy + 1) * 3 + (dx + 1)
+static const enum direction delta_dir[9] = {
+	DIR_NW, DIR_N, DIR_NE,
+	DIR_W,  DIR_N, DIR_E,
+	DIR_SW, DIR_S, DIR_SE,
+};
+
+enum direction bullet_dir(struct bullets *bullets, u32 i) {
+	u8 dx = bullets->dx[i] + 1, dy = bullets->dy[i] + 1;
+	return delta_dir[dy*3 + dx];
+}
+
+void resize_puzzle(struct puzzle *puzzle, u32 width, u32 height, u32 num_emitters) {
+	assert(width <= MAX_WIDTH && height <= MAX_HEIGHT);
+	u32 size = width * height;
+	// each ray holds at most one bullet per cell, counting the one just fired
+	u32 max_bullets = num_emitters * NUM_DIRS * MAX(width, height);
+	struct bullets *bullets = &puzzle->bullets;
+	puzzle->width        = width;
+	puzzle->height       = height;
+	puzzle->num_emitters = num_emitters;
+	puzzle->num_bullets  = 0;
+	puzzle->max_bullets  = max_bullets;
+	puzzle->emitters  = realloc(puzzle->emitters, num_emitters * sizeof(*puzzle->emitters));
+	puzzle->tiles     = realloc(puzzle->tiles, size * sizeof(*puzzle->tiles));
+	puzzle->occupancy = realloc(puzzle->occupancy, size * sizeof(*puzzle->occupancy));
+	bullets->x  = realloc(bullets->x,  max_bullets * sizeof(*bullets->x));
+	bullets->y  = realloc(bullets->y,  max_bullets * sizeof(*bullets->y));
+	bullets->dx = realloc(bullets->dx, max_bullets * sizeof(*bullets->dx));
+	bullets->dy = realloc(bullets->dy, max_bullets * sizeof(*bullets->dy));
+	memset(puzzle->occupancy, 0, size * sizeof(*puzzle->occupancy));
+}
+
+void free_puzzle(struct puzzle *puzzle) {
+	free(puzzle->emitters);
+	free(puzzle->tiles);
+	free(puzzle->occupancy);
+	free(puzzle->bullets.x);
+	free(puzzle->bullets.y);
+	free(puzzle->bullets.dx);
+	free(puzzle->bullets.dy);
+	memset(puzzle, 0, sizeof(*puzzle));
+}
+
+u32 bullets_at(struct puzzle *puzzle, u32 x, u32 y) {
+	if (x >= puzzle->width || y >= puzzle->height) {
+		return 0;
+	}
+	return puzzle->occupancy[y*puzzle->width + x];
+}
+
+// Occupancy upkeep around a step: every bullet on the board moves, so the
+// cells they start on are cleared before the survivors are marked again.
+static void lift_bullets(struct puzzle *puzzle) {
+	struct bullets *bullets = &puzzle->bullets;
+	u32 w = puzzle->width;
+	for (u32 i = 0; i < puzzle->num_bullets; ++i) {
+		puzzle->occupancy[bullets->y[i]*w + bullets->x[i]] = 0;
+	}
+}
+
+static void place_bullets(struct puzzle *puzzle) {
+	struct bullets *bullets = &puzzle->bullets;
+	u32 w = puzzle->width;
+	for (u32 i = 0; i < puzzle->num_bullets; ++i) {
+		puzzle->occupancy[bullets->y[i]*w + bullets->x[i]] |= 1 << bullet_dir(bullets, i);
+	}
+}
+
 void print_puzzle(struct puzzle *puzzle) {
 	printf("num_bullets: %u\n", puzzle->num_bullets);
 	u32 w = puzzle->width, h = puzzle->height;
@@ -47,27 +123,25 @@ void print_puzzle(struct puzzle *puzzle) {
 				line[i] = '@';
 				goto next_i;
 			}
-			struct bullet *bullets = puzzle->bullets;
-			for (u32 k = 0; k < puzzle->num_bullets; ++k) {
-				if (i == bullets[k].x && j == bullets[k].y) {
-					switch (bullets[k].dir) {
-					case DIR_N:
-					case DIR_S:
-						line[i] = '|';
-						goto next_i;
-					case DIR_E:
-					case DIR_W:
-						line[i] = '-';
-						goto next_i;
-					case DIR_NE:
-					case DIR_SW:
-						line[i] = '/';
-						goto next_i;
-					case DIR_NW:
-					case DIR_SE:
-						line[i] = '\\';
-						goto next_i;
-					}
+			u32 dirs = bullets_at(puzzle, i, j);
+			if (dirs) {
+				switch ((enum direction)__builtin_ctz(dirs)) {
+				case DIR_N:
+				case DIR_S:
+					line[i] = '|';
+					goto next_i;
+				case DIR_E:
+				case DIR_W:
+					line[i] = '-';
+					goto next_i;
+				case DIR_NE:
+				case DIR_SW:
+					line[i] = '/';
+					goto next_i;
+				case DIR_NW:
+				case DIR_SE:
+					line[i] = '\\';
+					goto next_i;
 				}
 			}
 			switch (puzzle->tiles[j*w + i]) {
@@ -91,24 +165,20 @@ void print_puzzle(struct puzzle *puzzle) {
 }
 
 static const u32 acceptable_step_lengths[] = { 1, 2, 3, 4, 6, 8 };
-struct puzzle generate_puzzle(u32 width, u32 height, u32 num_emitters) {
-	struct puzzle puzzle;
-	puzzle.width  = width;
-	puzzle.height = height;
-	puzzle.num_emitters = num_emitters;
-	puzzle.num_bullets  = 0;
+void generate_puzzle(struct puzzle *puzzle, u32 width, u32 height, u32 num_emitters) {
+	resize_puzzle(puzzle, width, height, num_emitters);
 	for (u32 j = 0; j < height; ++j) {
 		for (u32 i = 0; i < width; ++i) {
-			puzzle.tiles[j*width + i] = TILE_EMPTY;
+			puzzle->tiles[j*width + i] = TILE_EMPTY;
 		}
 	}
 	for (u32 i = 0; i < num_emitters; ++i) {
-		struct emitter *e = &puzzle.emitters[i];
+		struct emitter *e = &puzzle->emitters[i];
 		u32 x, y;
 		do {
 			x = rand() % width; y = rand() % height;
-		} while (puzzle.tiles[y*width + x] != TILE_EMPTY);
-		puzzle.tiles[y*width + x] = TILE_EMITTER;
+		} while (puzzle->tiles[y*width + x] != TILE_EMPTY);
+		puzzle->tiles[y*width + x] = TILE_EMITTER;
 		e->x = x; e->y = y;
 		e->type       = rand() % 3;
 		e->dir_mask   = rand() & 0xFF;
@@ -119,502 +189,819 @@ struct puzzle generate_puzzle(u32 width, u32 height, u32 num_emitters) {
 		} while (!e->fire_mask);
 		e->step       = (rand() % e->num_steps) + 1;
 	}
-	puzzle.player.x = width + 1;
+	puzzle->player.x = width + 1;
+	puzzle->player.y = height + 1;
+	// skip the old MAX(width, height) tick warm-up: move the emitters on
+	// in closed form and lay the bullets down from their rays
 	u32 steps_to_init = MAX(width, height);
-	for (u32 i = 0; i < steps_to_init; ++i) {
-		step_puzzle(&puzzle, PLAYER_MOVE_PAUSE, NULL);
+	for (u32 i = 0; i < num_emitters; ++i) {
+		advance_emitter(&puzzle->emitters[i], steps_to_init);
+	}
+	steady_state_bullets(puzzle);
+	puzzle->tick = 0;
+}
+
+static u32 wall_words(u32 w, u32 h) {
+	return (w * h + 63) / 64;
+}
+
+void snapshot_puzzle(struct puzzle_snapshot *snapshot, struct puzzle *puzzle) {
+	u32 w = puzzle->width, h = puzzle->height;
+	snapshot->walls    = realloc(snapshot->walls, wall_words(w, h) * sizeof(*snapshot->walls));
+	snapshot->emitters = realloc(snapshot->emitters,
+	                             puzzle->num_emitters * sizeof(*snapshot->emitters));
+	memset(snapshot->walls, 0, wall_words(w, h) * sizeof(*snapshot->walls));
+	snapshot->width    = w;
+	snapshot->height   = h;
+	snapshot->player_x = puzzle->player.x;
+	snapshot->player_y = puzzle->player.y;
+	snapshot->goal_x   = w;
+	snapshot->goal_y   = h;
+	snapshot->tick     = puzzle->tick;
+	for (u32 j = 0; j < h; ++j) {
+		for (u32 i = 0; i < w; ++i) {
+			u32 c = j*w + i;
+			switch (puzzle->tiles[c]) {
+			case TILE_WALL:
+				snapshot->walls[c / 64] |= 1ull << (c % 64);
+				break;
+			case TILE_GOAL:
+				snapshot->goal_x = i; snapshot->goal_y = j;
+				break;
+			case TILE_EMPTY:
+			case TILE_EMITTER:
+				break;
+			}
+		}
+	}
+	snapshot->num_emitters = puzzle->num_emitters;
+	for (u32 i = 0; i < puzzle->num_emitters; ++i) {
+		struct emitter *e = &puzzle->emitters[i];
+		snapshot->emitters[i] = (struct emitter_snapshot) {
+			.type = e->type, .x = e->x, .y = e->y,
+			.dir_mask = e->dir_mask, .step = e->step,
+			.num_steps = e->num_steps, .fire_mask = e->fire_mask,
+		};
+	}
+}
+
+static void restore_layout(struct puzzle *puzzle, struct puzzle_snapshot *snapshot) {
+	u32 w = snapshot->width, h = snapshot->height;
+	resize_puzzle(puzzle, w, h, snapshot->num_emitters);
+	puzzle->player.x = snapshot->player_x;
+	puzzle->player.y = snapshot->player_y;
+	puzzle->tick     = snapshot->tick;
+	for (u32 c = 0; c < w*h; ++c) {
+		puzzle->tiles[c] = (snapshot->walls[c / 64] >> (c % 64)) & 1 ? TILE_WALL : TILE_EMPTY;
+	}
+	if (snapshot->goal_x < w && snapshot->goal_y < h) {
+		puzzle->tiles[snapshot->goal_y*w + snapshot->goal_x] = TILE_GOAL;
+	}
+	for (u32 i = 0; i < snapshot->num_emitters; ++i) {
+		struct emitter_snapshot *e = &snapshot->emitters[i];
+		puzzle->emitters[i] = (struct emitter) {
+			.type = e->type, .x = e->x, .y = e->y,
+			.dir_mask = e->dir_mask, .step = e->step,
+			.num_steps = e->num_steps, .fire_mask = e->fire_mask,
+		};
+		puzzle->tiles[e->y*w + e->x] = TILE_EMITTER;
+	}
+}
+
+void restore_puzzle(struct puzzle *puzzle, struct puzzle_snapshot *snapshot) {
+	restore_layout(puzzle, snapshot);
+	steady_state_bullets(puzzle);
+}
+
+void copy_snapshot(struct puzzle_snapshot *dst, struct puzzle_snapshot *src) {
+	u32 words = wall_words(src->width, src->height);
+	u64 *walls = realloc(dst->walls, words * sizeof(*walls));
+	struct emitter_snapshot *emitters = realloc(dst->emitters,
+	                                            src->num_emitters * sizeof(*emitters));
+	memcpy(walls, src->walls, words * sizeof(*walls));
+	memcpy(emitters, src->emitters, src->num_emitters * sizeof(*emitters));
+	*dst = *src;
+	dst->walls    = walls;
+	dst->emitters = emitters;
+}
+
+void free_snapshot(struct puzzle_snapshot *snapshot) {
+	free(snapshot->walls);
+	free(snapshot->emitters);
+	memset(snapshot, 0, sizeof(*snapshot));
+}
+
+void advance_emitter(struct emitter *e, u32 ticks) {
+	u32 r = ticks % NUM_DIRS;
+	switch (e->type) {
+	case EMITTER_FIXED:
+		break;
+	case EMITTER_CLOCKWISE:
+		e->dir_mask = ((e->dir_mask << r) | (e->dir_mask >> (NUM_DIRS - r))) & 0xFF;
+		break;
+	case EMITTER_COUNTER_CLOCKWISE:
+		e->dir_mask = ((e->dir_mask >> r) | (e->dir_mask << (NUM_DIRS - r))) & 0xFF;
+		break;
+	}
+	e->step = (e->step - 1 + ticks % e->num_steps) % e->num_steps + 1;
+}
+
+void advance_snapshot(struct puzzle_snapshot *snapshot, u32 ticks) {
+	for (u32 i = 0; i < snapshot->num_emitters; ++i) {
+		struct emitter_snapshot *s = &snapshot->emitters[i];
+		struct emitter e = {
+			.type = s->type, .dir_mask = s->dir_mask,
+			.step = s->step, .num_steps = s->num_steps,
+		};
+		advance_emitter(&e, ticks);
+		s->dir_mask = e.dir_mask;
+		s->step     = e.step;
+	}
+	snapshot->tick += ticks;
+}
+
+void seek_puzzle(struct puzzle *puzzle, struct puzzle_snapshot *snapshot, u32 ticks) {
+	restore_layout(puzzle, snapshot);
+	for (u32 i = 0; i < puzzle->num_emitters; ++i) {
+		advance_emitter(&puzzle->emitters[i], ticks);
+	}
+	puzzle->tick += ticks;
+	steady_state_bullets(puzzle);
+}
+
+static enum move_response step_player(struct puzzle *puzzle,
+                                      enum player_move player_move,
+                                      struct anim_queue *anim_queue) {
+	enum tile *tiles = puzzle->tiles;
+	u32 w = puzzle->width, h = puzzle->height;
+	u32 x = puzzle->player.x, y = puzzle->player.y;
+	switch (player_move) {
+	case PLAYER_MOVE_N:
+		step_coords(&x, &y, DIR_N);
+		break;
+	case PLAYER_MOVE_E:
+		step_coords(&x, &y, DIR_E);
+		break;
+	case PLAYER_MOVE_S:
+		step_coords(&x, &y, DIR_S);
+		break;
+	case PLAYER_MOVE_W:
+		step_coords(&x, &y, DIR_W);
+		break;
+	case PLAYER_MOVE_PAUSE:
+		break;
+	}
+	if (x < w && y < h && (tiles[y*w + x] == TILE_EMPTY || tiles[y*w + x] == TILE_GOAL)) {
+		if (anim_queue != NULL) {
+			anim_queue->queue[anim_queue->len++] = (struct anim) {
+				.type = ANIMATION_PLAYER_MOVE,
+				.player_move = {
+					.sx = puzzle->player.x, .sy = puzzle->player.y,
+					.ex = x, .ey = y,
+				},
+			};
+		}
+		puzzle->player.x = x; puzzle->player.y = y;
+		if (tiles[y*w + x] == TILE_GOAL) {
+			return MOVE_RESPONSE_VICTORY;
+		}
+	}
+	return MOVE_RESPONSE_NONE;
+}
+
+u32 step_emitter(struct emitter *e) {
+	switch (e->type) {
+	case EMITTER_FIXED:
+		break;
+	case EMITTER_CLOCKWISE:
+		e->dir_mask <<= 1;
+		e->dir_mask |= e->dir_mask >> 8;
+		e->dir_mask &= 0xFF;
+		break;
+	case EMITTER_COUNTER_CLOCKWISE:
+		e->dir_mask |= e->dir_mask << 8;
+		e->dir_mask >>= 1;
+		e->dir_mask &= 0xFF;
+		break;
+	}
+	++e->step;
+	if (e->step > e->num_steps) {
+		e->step = 1;
+	}
+	if ((1 << (e->step - 1)) & e->fire_mask) {
+		return e->dir_mask;
+	}
+	return 0;
+}
+
+// Makes room for n more anims on the queue.
+static void reserve_anims(struct anim_queue *anim_queue, u32 n) {
+	if (anim_queue->len + n > anim_queue->max_len) {
+		anim_queue->max_len = anim_queue->len + n;
+		anim_queue->queue = realloc(anim_queue->queue,
+		                            anim_queue->max_len * sizeof(*anim_queue->queue));
+	}
+}
+
+static void queue_bullet_anims(struct puzzle *puzzle, u32 num_bullets,
+                               u32 p_sx, u32 p_sy, struct anim_queue *anim_queue) {
+	struct bullets *bullets = &puzzle->bullets;
+	enum tile *tiles = puzzle->tiles;
+	u32 w = puzzle->width, h = puzzle->height;
+	u32 p_ex = puzzle->player.x, p_ey = puzzle->player.y;
+	for (u32 i = 0; i < num_bullets; ++i) {
+		u32 sx = bullets->x[i], sy = bullets->y[i];
+		enum direction dir = bullet_dir(bullets, i);
+		u32 ex = sx + dir_dx[dir], ey = sy + dir_dy[dir];
+		u32 type = ANIMATION_BULLET_MOVE;
+		if (ex >= w || ey >= h
+		 || tiles[ey*w + ex] == TILE_EMITTER || tiles[ey*w + ex] == TILE_WALL) {
+			type = ANIMATION_BULLET_EXPLODE_EDGE;
+		} else if (ex == p_ex && ey == p_ey) {
+			type = ANIMATION_BULLET_EXPLODE_MID;
+		} else if (ex == p_sx && ey == p_sy && sx == p_ex && sy == p_ey) {
+			type = ANIMATION_BULLET_EXPLODE_EDGE;
+		}
+		if (type == ANIMATION_BULLET_MOVE) {
+			anim_queue->queue[anim_queue->len++] = (struct anim) {
+				.type = ANIMATION_BULLET_MOVE,
+				.bullet_move = {
+					.sx = sx, .sy = sy,
+					.ex = ex, .ey = ey,
+					.dir = dir,
+				},
+			};
+		} else {
+			anim_queue->queue[anim_queue->len++] = (struct anim) {
+				.type = type,
+				.bullet_explode = {
+					.sx = sx, .sy = sy,
+					.ex = ex, .ey = ey,
+					.dir = dir,
+					.added_explosion = 0,
+				},
+			};
+		}
+	}
+}
+
+static u32 fire_emitters(struct puzzle *puzzle, u32 num_bullets) {
+	struct bullets *bullets = &puzzle->bullets;
+	u32 num_emitters = puzzle->num_emitters;
+	for (u32 i = 0; i < num_emitters; ++i) {
+		struct emitter *e = &puzzle->emitters[i];
+		u32 fired = step_emitter(e);
+		for (u32 d = 0; d < NUM_DIRS; ++d) {
+			if (fired & (1 << d)) {
+				bullets->x[num_bullets]  = e->x;
+				bullets->y[num_bullets]  = e->y;
+				bullets->dx[num_bullets] = dir_dx[d];
+				bullets->dy[num_bullets] = dir_dy[d];
+				++num_bullets;
+			}
+		}
+	}
+	return num_bullets;
+}
+
+static void move_bullets(struct bullets *bullets, u32 num_bullets) {
+	u16 *restrict bx  = bullets->x,  *restrict by  = bullets->y;
+	u16 *restrict bdx = bullets->dx, *restrict bdy = bullets->dy;
+	for (u32 i = 0; i < num_bullets; ++i) {
+		bx[i] += bdx[i];
+		by[i] += bdy[i];
 	}
-	return puzzle;
 }
 
 enum move_response step_puzzle(struct puzzle *puzzle,
                                enum player_move player_move,
                                struct anim_queue *anim_queue) {
-	enum move_response result = MOVE_RESPONSE_NONE;
 	enum tile *tiles = puzzle->tiles;
-	u32 num_bullets = puzzle->num_bullets;
-	struct bullet *bullets = puzzle->bullets;
+	struct bullets *bullets = &puzzle->bullets;
+	u16 *restrict bx  = bullets->x,  *restrict by  = bullets->y;
+	u16 *restrict bdx = bullets->dx, *restrict bdy = bullets->dy;
 	u32 w = puzzle->width, h = puzzle->height;
-	u32 p_sx, p_sy, p_ex, p_ey;
-	{ // step player
-		u32 x = puzzle->player.x, y = puzzle->player.y;
-		switch (player_move) {
-		case PLAYER_MOVE_N:
-			step_coords(&x, &y, DIR_N);
-			break;
-		case PLAYER_MOVE_E:
-			step_coords(&x, &y, DIR_E);
-			break;
-		case PLAYER_MOVE_S:
-			step_coords(&x, &y, DIR_S);
-			break;
-		case PLAYER_MOVE_W:
-			step_coords(&x, &y, DIR_W);
-			break;
-		case PLAYER_MOVE_PAUSE:
-			break;
+	u32 p_sx = puzzle->player.x, p_sy = puzzle->player.y;
+	if (anim_queue != NULL) {
+		reserve_anims(anim_queue, puzzle->max_bullets + 1);
+	}
+	enum move_response result = step_player(puzzle, player_move, anim_queue);
+	u32 p_ex = puzzle->player.x, p_ey = puzzle->player.y;
+	++puzzle->tick;
+	lift_bullets(puzzle);
+	u32 num_bullets = fire_emitters(puzzle, puzzle->num_bullets);
+	if (anim_queue != NULL) {
+		queue_bullet_anims(puzzle, num_bullets, p_sx, p_sy, anim_queue);
+	}
+	move_bullets(bullets, num_bullets);
+	u32 n = 0;
+	for (u32 i = 0; i < num_bullets; ++i) {
+		u32 x = bx[i], y = by[i];
+		u32 alive = x < w && y < h
+		         && (tiles[y*w + x] == TILE_EMPTY || tiles[y*w + x] == TILE_GOAL);
+		u32 hit = (x == p_ex && y == p_ey)
+		       || (x == p_sx && y == p_sy
+		        && (u16)(x - bdx[i]) == p_ex && (u16)(y - bdy[i]) == p_ey);
+		if (alive && hit) {
+			result = MOVE_RESPONSE_DEATH;
 		}
-		if (x < w && y < h && (tiles[y*w + x] == TILE_EMPTY || tiles[y*w + x] == TILE_GOAL)) {
-			p_sx = puzzle->player.x; p_sy = puzzle->player.y;
-			p_ex = x; p_ey = y;
-			if (anim_queue != NULL) {
-				anim_queue->queue[anim_queue->len++] = (struct anim) {
-					.type = ANIMATION_PLAYER_MOVE,
-					.player_move = {
-						.sx = p_sx, .sy = p_sy,
-						.ex = p_ex, .ey = p_ey,
-					},
-				};
-			}
-			puzzle->player.x = x; puzzle->player.y = y;
-			if (tiles[y*w + x] == TILE_GOAL) {
-				result = MOVE_RESPONSE_VICTORY;
+		bx[n]  = x;      by[n]  = y;
+		bdx[n] = bdx[i]; bdy[n] = bdy[i];
+		n += alive && !hit;
+	}
+	puzzle->num_bullets = n;
+	place_bullets(puzzle);
+	return result;
+}
+
+void step_puzzle_headless(struct puzzle *puzzle) {
+	enum tile *tiles = puzzle->tiles;
+	struct bullets *bullets = &puzzle->bullets;
+	u16 *restrict bx  = bullets->x,  *restrict by  = bullets->y;
+	u16 *restrict bdx = bullets->dx, *restrict bdy = bullets->dy;
+	u32 w = puzzle->width, h = puzzle->height;
+	++puzzle->tick;
+	lift_bullets(puzzle);
+	u32 num_bullets = fire_emitters(puzzle, puzzle->num_bullets);
+	move_bullets(bullets, num_bullets);
+	u32 n = 0;
+	for (u32 i = 0; i < num_bullets; ++i) {
+		u32 x = bx[i], y = by[i];
+		bx[n]  = x;      by[n]  = y;
+		bdx[n] = bdx[i]; bdy[n] = bdy[i];
+		n += x < w && y < h
+		  && (tiles[y*w + x] == TILE_EMPTY || tiles[y*w + x] == TILE_GOAL);
+	}
+	puzzle->num_bullets = n;
+	place_bullets(puzzle);
+}
+
+static u64 *board_row(struct bitboard *board, u32 d, u32 y) {
+	return board->rows + (d * board->height + y) * board->words;
+}
+
+static u32 board_bit(struct bitboard *board, u64 *rows, u32 x, u32 y) {
+	return (rows[y * board->words + x / 64] >> (x % 64)) & 1;
+}
+
+static void size_bitboard(struct bitboard *board, u32 w, u32 h) {
+	u32 words = (w + 63) / 64;
+	board->height = h;
+	board->words  = words;
+	board->open   = realloc(board->open, h * words * sizeof(*board->open));
+	board->rows   = realloc(board->rows, NUM_DIRS * h * words * sizeof(*board->rows));
+	memset(board->open, 0, h * words * sizeof(*board->open));
+	memset(board->rows, 0, NUM_DIRS * h * words * sizeof(*board->rows));
+}
+
+void bitboard_from_puzzle(struct bitboard *board, struct puzzle *puzzle) {
+	u32 w = puzzle->width, h = puzzle->height;
+	size_bitboard(board, w, h);
+	u32 words = board->words;
+	for (u32 j = 0; j < h; ++j) {
+		for (u32 i = 0; i < w; ++i) {
+			enum tile tile = puzzle->tiles[j*w + i];
+			if (tile == TILE_EMPTY || tile == TILE_GOAL) {
+				board->open[j*words + i/64] |= 1ull << (i % 64);
 			}
 		}
 	}
-	{ // step emitters
-		u32 num_emitters = puzzle->num_emitters;
-		for (u32 i = 0; i < num_emitters; ++i) {
-			struct emitter *e = &puzzle->emitters[i];
-			switch (e->type) {
-			case EMITTER_FIXED:
-				goto fire_emitter;
-			case EMITTER_CLOCKWISE:
-				e->dir_mask <<= 1;
-				e->dir_mask |= e->dir_mask >> 8;
-				e->dir_mask &= 0xFF;
-				goto fire_emitter;
-			case EMITTER_COUNTER_CLOCKWISE:
-				e->dir_mask |= e->dir_mask << 8;
-				e->dir_mask >>= 1;
-				e->dir_mask &= 0xFF;
-				goto fire_emitter;
-			}
-		fire_emitter:
-			++e->step;
-			if (e->step > e->num_steps) {
-				e->step = 1;
+	u32 num_bullets = puzzle->num_bullets;
+	struct bullets *bullets = &puzzle->bullets;
+	for (u32 i = 0; i < num_bullets; ++i) {
+		u32 x = bullets->x[i];
+		board_row(board, bullet_dir(bullets, i), bullets->y[i])[x / 64] |= 1ull << (x % 64);
+	}
+}
+
+void bitboard_to_puzzle(struct puzzle *puzzle, struct bitboard *board) {
+	u32 num_bullets = 0;
+	struct bullets *bullets = &puzzle->bullets;
+	u32 w = puzzle->width;
+	memset(puzzle->occupancy, 0, w * puzzle->height);
+	for (u32 d = 0; d < NUM_DIRS; ++d) {
+		for (u32 j = 0; j < puzzle->height; ++j) {
+			u64 *rows = board_row(board, d, j);
+			for (u32 k = 0; k < board->words; ++k) {
+				for (u64 row = rows[k]; row; row &= row - 1) {
+					u32 x = k*64 + __builtin_ctzll(row);
+					puzzle->occupancy[j*w + x] |= 1 << d;
+					bullets->x[num_bullets]  = x;
+					bullets->y[num_bullets]  = j;
+					bullets->dx[num_bullets] = dir_dx[d];
+					bullets->dy[num_bullets] = dir_dy[d];
+					++num_bullets;
+				}
 			}
-			if ((1 << (e->step - 1)) & e->fire_mask) {
-				for (u32 d = 0; d < NUM_DIRS; ++d) {
-					if (e->dir_mask & (1 << d)) {
-						bullets[num_bullets++] = (struct bullet) {
-							.x = e->x, .y = e->y,
-							.dir = (enum direction)d,
+		}
+	}
+	puzzle->num_bullets = num_bullets;
+}
+
+void free_bitboard(struct bitboard *board) {
+	free(board->open);
+	free(board->rows);
+	memset(board, 0, sizeof(*board));
+}
+
+static void queue_bitboard_anims(struct bitboard *board, u32 w, u32 h,
+                                 u32 p_sx, u32 p_sy, u32 p_ex, u32 p_ey,
+                                 struct anim_queue *anim_queue) {
+	for (u32 d = 0; d < NUM_DIRS; ++d) {
+		for (u32 j = 0; j < h; ++j) {
+			u64 *rows = board_row(board, d, j);
+			for (u32 k = 0; k < board->words; ++k) {
+				for (u64 row = rows[k]; row; row &= row - 1) {
+					u32 sx = k*64 + __builtin_ctzll(row), sy = j;
+					u32 ex = sx + dir_dx[d], ey = sy + dir_dy[d];
+					u32 type = ANIMATION_BULLET_MOVE;
+					if (ex >= w || ey >= h || !board_bit(board, board->open, ex, ey)) {
+						type = ANIMATION_BULLET_EXPLODE_EDGE;
+					} else if (ex == p_ex && ey == p_ey) {
+						type = ANIMATION_BULLET_EXPLODE_MID;
+					} else if (ex == p_sx && ey == p_sy && sx == p_ex && sy == p_ey) {
+						type = ANIMATION_BULLET_EXPLODE_EDGE;
+					}
+					if (type == ANIMATION_BULLET_MOVE) {
+						anim_queue->queue[anim_queue->len++] = (struct anim) {
+							.type = ANIMATION_BULLET_MOVE,
+							.bullet_move = {
+								.sx = sx, .sy = sy,
+								.ex = ex, .ey = ey,
+								.dir = (enum direction)d,
+							},
+						};
+					} else {
+						anim_queue->queue[anim_queue->len++] = (struct anim) {
+							.type = type,
+							.bullet_explode = {
+								.sx = sx, .sy = sy,
+								.ex = ex, .ey = ey,
+								.dir = (enum direction)d,
+								.added_explosion = 0,
+							},
 						};
 					}
 				}
 			}
-			continue;
 		}
 	}
-	{ // step bullets
-		u32 i = 0;
-		while (i < num_bullets) {
-			struct bullet *b = &bullets[i];
-			u32 sx = b->x, sy = b->y;
-			step_coords(&b->x, &b->y, b->dir);
-			if (b->x >= w || b->y >= h) {
-				if (anim_queue != NULL) {
-					anim_queue->queue[anim_queue->len++] = (struct anim) {
-						.type = ANIMATION_BULLET_EXPLODE_EDGE,
-						.bullet_explode = {
-							.sx = sx,   .sy = sy,
-							.ex = b->x, .ey = b->y,
-							.dir = b->dir,
-							.added_explosion = 0,
-						},
-					};
-				}
-				bullets[i] = bullets[--num_bullets];
-				continue;
+}
+
+static void fire_emitters_bitboard(struct puzzle *puzzle, struct bitboard *board) {
+	u32 num_emitters = puzzle->num_emitters;
+	for (u32 i = 0; i < num_emitters; ++i) {
+		struct emitter *e = &puzzle->emitters[i];
+		u32 fired = step_emitter(e);
+		for (u32 d = 0; d < NUM_DIRS; ++d) {
+			if (fired & (1 << d)) {
+				board_row(board, d, e->y)[e->x / 64] |= 1ull << (e->x % 64);
 			}
-			enum tile tile = tiles[b->y*w + b->x];
-			if (tile == TILE_EMITTER || tile == TILE_WALL) {
-				if (anim_queue != NULL) {
-					anim_queue->queue[anim_queue->len++] = (struct anim) {
-						.type = ANIMATION_BULLET_EXPLODE_EDGE,
-						.bullet_explode = {
-							.sx = sx,   .sy = sy,
-							.ex = b->x, .ey = b->y,
-							.dir = b->dir,
-							.added_explosion = 0,
-						},
-					};
-				}
-				bullets[i] = bullets[--num_bullets];
-				continue;
+		}
+	}
+}
+
+// Moves a plane one cell along (dx, dy) and drops whatever doesn't land on an
+// open cell. Rows and words are walked against the direction of travel, so
+// every source word is read before it is overwritten and the shift can happen
+// in place.
+static void shift_plane(u64 *rows, u64 *open, u32 h, u32 words, s32 dx, s32 dy) {
+	if (words == 1) {
+		// boards up to 64 wide: shift the whole plane through a copy, which
+		// vectorizes across rows
+		u64 next[MAX_HEIGHT];
+		for (u32 j = 0; j < h; ++j) {
+			u32 sj = j - dy;
+			u64 row = sj < h ? rows[sj] : 0;
+			if (dx > 0) {
+				row <<= 1;
+			} else if (dx < 0) {
+				row >>= 1;
 			}
-			if (b->x == puzzle->player.x && b->y == puzzle->player.y) {
-				if (anim_queue != NULL) {
-					anim_queue->queue[anim_queue->len++] = (struct anim) {
-						.type = ANIMATION_BULLET_EXPLODE_MID,
-						.bullet_explode = {
-							.sx = sx,   .sy = sy,
-							.ex = b->x, .ey = b->y,
-							.dir = b->dir,
-							.added_explosion = 0,
-						},
-					};
-				}
-				bullets[i] = bullets[--num_bullets];
-				result = MOVE_RESPONSE_DEATH;
-				continue;
+			next[j] = row & open[j];
+		}
+		memcpy(rows, next, h * sizeof(*next));
+		return;
+	}
+	s32 start = dy > 0 ? (s32)h - 1 : 0, end = dy > 0 ? -1 : (s32)h;
+	s32 inc = dy > 0 ? -1 : 1;
+	for (s32 j = start; j != end; j += inc) {
+		s32 sj = j - dy;
+		u64 *next = rows + j*words;
+		if (sj < 0 || sj >= (s32)h) {
+			memset(next, 0, words * sizeof(*next));
+			continue;
+		}
+		u64 *src = rows + sj*words, *mask = open + j*words;
+		if (dx > 0) {
+			for (u32 k = words - 1; k > 0; --k) {
+				next[k] = ((src[k] << 1) | (src[k - 1] >> 63)) & mask[k];
 			}
-			if (p_sx == b->x && p_sy == b->y && p_ex == sx && p_ey == sy) {
-				if (anim_queue != NULL) {
-					anim_queue->queue[anim_queue->len++] = (struct anim) {
-						.type = ANIMATION_BULLET_EXPLODE_EDGE,
-						.bullet_explode = {
-							.sx = sx,   .sy = sy,
-							.ex = b->x, .ey = b->y,
-							.dir = b->dir,
-							.added_explosion = 0,
-						},
-					};
-				}
-				bullets[i] = bullets[--num_bullets];
-				result = MOVE_RESPONSE_DEATH;
-				continue;
+			next[0] = (src[0] << 1) & mask[0];
+		} else if (dx < 0) {
+			for (u32 k = 0; k < words - 1; ++k) {
+				next[k] = ((src[k] >> 1) | (src[k + 1] << 63)) & mask[k];
 			}
-			if (anim_queue != NULL) {
-				anim_queue->queue[anim_queue->len++] = (struct anim) {
-					.type = ANIMATION_BULLET_MOVE,
-					.bullet_move = {
-						.sx = sx,   .sy = sy,
-						.ex = b->x, .ey = b->y,
-						.dir = b->dir,
-					},
-				};
+			next[words - 1] = (src[words - 1] >> 1) & mask[words - 1];
+		} else {
+			for (u32 k = 0; k < words; ++k) {
+				next[k] = src[k] & mask[k];
 			}
-			++i;
 		}
 	}
-	puzzle->num_bullets = num_bullets;
+}
+
+enum move_response step_puzzle_bitboard(struct puzzle *puzzle, struct bitboard *board,
+                                        enum player_move player_move,
+                                        struct anim_queue *anim_queue) {
+	u32 w = puzzle->width, h = puzzle->height;
+	u32 p_sx = puzzle->player.x, p_sy = puzzle->player.y;
+	if (anim_queue != NULL) {
+		reserve_anims(anim_queue, puzzle->max_bullets + 1);
+	}
+	enum move_response result = step_player(puzzle, player_move, anim_queue);
+	u32 p_ex = puzzle->player.x, p_ey = puzzle->player.y;
+	++puzzle->tick;
+	fire_emitters_bitboard(puzzle, board);
+	if (anim_queue != NULL) {
+		queue_bitboard_anims(board, w, h, p_sx, p_sy, p_ex, p_ey, anim_queue);
+	}
+	u32 on_board = p_ex < w && p_ey < h, swap_dir = NUM_DIRS;
+	for (u32 d = 0; d < NUM_DIRS; ++d) {
+		if (p_sx - p_ex == (u32)dir_dx[d] && p_sy - p_ey == (u32)dir_dy[d]) {
+			swap_dir = d;
+		}
+	}
+	for (u32 d = 0; d < NUM_DIRS; ++d) {
+		shift_plane(board_row(board, d, 0), board->open, h, board->words,
+		            dir_dx[d], dir_dy[d]);
+		if (on_board && board_bit(board, board_row(board, d, 0), p_ex, p_ey)) {
+			board_row(board, d, p_ey)[p_ex / 64] &= ~(1ull << (p_ex % 64));
+			result = MOVE_RESPONSE_DEATH;
+		}
+		if (d == swap_dir && board_bit(board, board_row(board, d, 0), p_sx, p_sy)) {
+			board_row(board, d, p_sy)[p_sx / 64] &= ~(1ull << (p_sx % 64));
+			result = MOVE_RESPONSE_DEATH;
+		}
+	}
 	return result;
 }
 
-#define WALL                0x01000000
-#define WALL_FROM_N         0x10000000
-#define WALL_FROM_E         0x20000000
-#define WALL_FROM_S         0x40000000
-#define WALL_FROM_W         0x80000000
-#define COST_MASK           0x00FFFFFF
-#define ALWAYS_BLOCKED_MASK 0x0FFFFFFF
+static u64 *lane_word(struct puzzle_batch *batch, u64 *rows, u32 y, u32 k) {
+	return rows + (y * batch->words + k) * BATCH_LANES;
+}
 
-static u32 *map_xyz(struct map *map, u32 x, u32 y, u32 z) {
-	return map->data + (z * map->width * map->height) + (y * map->width) + x;
+static u64 *lane_row(struct puzzle_batch *batch, u32 d, u32 y) {
+	return lane_word(batch, batch->rows, d * batch->height + y, 0);
 }
 
-struct map generate_map(struct puzzle *puzzle) {
-	u32 period = 1;
-	for (u32 i = 0; i < puzzle->num_emitters; ++i) {
-		struct emitter *e = &puzzle->emitters[i];
-		switch(e->type) {
-			case EMITTER_FIXED:
-				period = lcm_u32(period, e->num_steps);
-				break;
-			case EMITTER_COUNTER_CLOCKWISE:
-			case EMITTER_CLOCKWISE:
-				period = lcm_u32(period, e->num_steps);
-				period = lcm_u32(period, 8);
-				break;
-		}
+void batch_from_puzzles(struct puzzle_batch *batch, struct puzzle **puzzles, u32 n) {
+	u32 h = 0, words = 0;
+	for (u32 l = 0; l < n; ++l) {
+		h     = MAX(h, puzzles[l]->height);
+		words = MAX(words, (puzzles[l]->width + 63) / 64);
 	}
-	u32 w = puzzle->width + 2, h = puzzle->height + 2;
-	struct map map;
-	map.width = w; map.height = h; map.period = period;
-	size_t map_size = w * h * period * sizeof(map.data);
-	map.data = malloc(map_size);
-	memset(map.data, 0, map_size);
-	u32 *p = map.data;
-	for (u32 k = 0; k < period; ++k) {
-		for (u32 j = 0; j < h; ++j) {
-			for (u32 i = 0; i < w; ++i, ++p) {
-				if (i == 0 || j == 0 || i == w-1 || j == h-1) {
-					*p = WALL;
-					continue;
-				}
-				enum tile tile = puzzle->tiles[(j - 1)*(w - 2) + (i - 1)];
-				switch (tile) {
-				case TILE_GOAL:
-					break;
-				case TILE_EMPTY:
-					break;
-				case TILE_EMITTER:
-					*p = WALL;
-					break;
-				case TILE_WALL:
-					*p = WALL;
-					break;
+	u32 plane = h * words * BATCH_LANES;
+	batch->num_lanes = n;
+	batch->height    = h;
+	batch->words     = words;
+	batch->open = realloc(batch->open, plane * sizeof(*batch->open));
+	batch->rows = realloc(batch->rows, NUM_DIRS * plane * sizeof(*batch->rows));
+	memset(batch->open, 0, plane * sizeof(*batch->open));
+	memset(batch->rows, 0, NUM_DIRS * plane * sizeof(*batch->rows));
+	struct bitboard board = {};
+	for (u32 l = 0; l < n; ++l) {
+		bitboard_from_puzzle(&board, puzzles[l]);
+		batch->puzzles[l] = puzzles[l];
+		for (u32 j = 0; j < board.height; ++j) {
+			for (u32 k = 0; k < board.words; ++k) {
+				lane_word(batch, batch->open, j, k)[l] = board.open[j*board.words + k];
+				for (u32 d = 0; d < NUM_DIRS; ++d) {
+					lane_row(batch, d, j)[k*BATCH_LANES + l] = board_row(&board, d, j)[k];
 				}
 			}
 		}
-		u32 num_bullets = puzzle->num_bullets;
-		struct bullet *b = puzzle->bullets;
-		for (u32 i = 0; i < num_bullets; ++i, ++b) {
-			u32 x = b->x, y = b->y;
-			enum direction dir = b->dir;
-			*map_xyz(&map, x+1, y+1, k) |= WALL;
-			switch (dir) {
-			case DIR_N:
-				step_coords(&x, &y, DIR_S);
-				*map_xyz(&map, x+1, y+1, k) |= WALL_FROM_N;
-				break;
-			case DIR_E:
-				step_coords(&x, &y, DIR_W);
-				*map_xyz(&map, x+1, y+1, k) |= WALL_FROM_E;
-				break;
-			case DIR_S:
-				step_coords(&x, &y, DIR_N);
-				*map_xyz(&map, x+1, y+1, k) |= WALL_FROM_S;
-				break;
-			case DIR_W:
-				step_coords(&x, &y, DIR_E);
-				*map_xyz(&map, x+1, y+1, k) |= WALL_FROM_W;
-				break;
-			default:
-				break;
-			}
-		}
-		step_puzzle(puzzle, PLAYER_MOVE_PAUSE, NULL);
 	}
-	return map;
+	free_bitboard(&board);
 }
 
-void print_map_page(struct map *map, u32 page) {
-	u32 w = map->width, h = map->height;
-	u32 *p = map->data + (w * h * page);
-	for (u32 j = 0; j < h; ++j) {
-		char line[MAX_WIDTH + 1] = {};
-		for (u32 i = 0; i < w; ++i, ++p) {
-			printf("%c:%08X    ", *p & WALL ? '#' : '.', *p);
+void batch_to_puzzles(struct puzzle_batch *batch) {
+	struct bitboard board = {};
+	for (u32 l = 0; l < batch->num_lanes; ++l) {
+		struct puzzle *puzzle = batch->puzzles[l];
+		size_bitboard(&board, puzzle->width, puzzle->height);
+		for (u32 j = 0; j < board.height; ++j) {
+			for (u32 k = 0; k < board.words; ++k) {
+				for (u32 d = 0; d < NUM_DIRS; ++d) {
+					board_row(&board, d, j)[k] = lane_row(batch, d, j)[k*BATCH_LANES + l];
+				}
+			}
 		}
-		printf("%s\n", line);
+		bitboard_to_puzzle(puzzle, &board);
 	}
+	free_bitboard(&board);
 }
 
-void reset_map(struct map *map) {
-	u32 map_size = map->width * map->height * map->period;
-	u32 *p = map->data;
-	for (u32 i = map_size; i; --i, ++p) {
-		*p &= 0xFF000000;
-	}
+void free_batch(struct puzzle_batch *batch) {
+	free(batch->open);
+	free(batch->rows);
+	memset(batch, 0, sizeof(*batch));
 }
 
-struct goal get_furthest_point(struct map *map, u32 x, u32 y) {
-	u32 w = map->width, h = map->height, period = map->period;
-	struct to_explore {
-		u32 x, y, period;
-	} *to_explore = malloc(w * h * period * sizeof(*to_explore));
-	u32 start = 0, end = 0;
-	for (u32 i = 0; i < period; ++i) {
-		u32 *p = map_xyz(map, x, y, i);
-		if (!(*p & WALL)) {
-			to_explore[end++] = (struct to_explore) {
-				.x = x, .y = y, .period = i,
-			};
-			*p |= 1;
-		}
-	}
-	u32 last_cost = 1, last_cost_start = 0;
-	while (start < end) {
-		struct to_explore this = to_explore[start++];
-		u32 this_tile = *map_xyz(map, this.x, this.y, this.period);
-		u32 cost = this_tile & COST_MASK;
-		if (cost != last_cost) {
-			last_cost = cost;
-			last_cost_start = start - 1;
-		}
-		++cost;
-		u32 n_x, n_y, n_p = (this.period + period - 1) % period;
-		// PLAYER_MOVE_PAUSE
-		n_x = this.x; n_y = this.y;
-		u32 *p = map_xyz(map, n_x, n_y, n_p);
-		if (!(*p & ALWAYS_BLOCKED_MASK)) {
-			to_explore[end++] = (struct to_explore) {
-				.x = n_x, .y = n_y, .period = n_p,
-			};
-			*p |= cost;
+// shift_plane with every word widened to BATCH_LANES lanes. Rows and words
+// past a lane's board are never open, so they stay empty and the loops need
+// no per-lane bounds.
+static void shift_lanes(u64 *rows, u64 *open, u32 h, u32 words, s32 dx, s32 dy) {
+	u32 stride = words * BATCH_LANES;
+	s32 start = dy > 0 ? (s32)h - 1 : 0, end = dy > 0 ? -1 : (s32)h;
+	s32 inc = dy > 0 ? -1 : 1;
+	for (s32 j = start; j != end; j += inc) {
+		s32 sj = j - dy;
+		u64 *next = rows + j*stride;
+		if (sj < 0 || sj >= (s32)h) {
+			memset(next, 0, stride * sizeof(*next));
+			continue;
 		}
-		// PLAYER_MOVE_N
-		if (!(this_tile & WALL_FROM_S)) {
-			n_x = this.x; n_y = this.y + 1;
-			p = map_xyz(map, n_x, n_y, n_p);
-			if (!(*p & ALWAYS_BLOCKED_MASK)) {
-				to_explore[end++] = (struct to_explore) {
-					.x = n_x, .y = n_y, .period = n_p,
-				};
-				*p |= cost;
+		u64 *src = rows + sj*stride, *mask = open + j*stride;
+		if (dx > 0) {
+			for (u32 k = words - 1; k > 0; --k) {
+				u64 *n = next + k*BATCH_LANES, *s = src + k*BATCH_LANES;
+				u64 *c = s - BATCH_LANES, *m = mask + k*BATCH_LANES;
+				for (u32 l = 0; l < BATCH_LANES; ++l) {
+					n[l] = ((s[l] << 1) | (c[l] >> 63)) & m[l];
+				}
 			}
-		}
-		// PLAYER_MOVE_E
-		if (!(this_tile & WALL_FROM_W)) {
-			n_x = this.x - 1; n_y = this.y;
-			p = map_xyz(map, n_x, n_y, n_p);
-			if (!(*p & ALWAYS_BLOCKED_MASK)) {
-				to_explore[end++] = (struct to_explore) {
-					.x = n_x, .y = n_y, .period = n_p,
-				};
-				*p |= cost;
+			for (u32 l = 0; l < BATCH_LANES; ++l) {
+				next[l] = (src[l] << 1) & mask[l];
+			}
+		} else if (dx < 0) {
+			for (u32 k = 0; k < words; ++k) {
+				u64 *n = next + k*BATCH_LANES, *s = src + k*BATCH_LANES;
+				u64 *c = s + BATCH_LANES, *m = mask + k*BATCH_LANES;
+				if (k + 1 == words) {
+					for (u32 l = 0; l < BATCH_LANES; ++l) {
+						n[l] = (s[l] >> 1) & m[l];
+					}
+					break;
+				}
+				for (u32 l = 0; l < BATCH_LANES; ++l) {
+					n[l] = ((s[l] >> 1) | (c[l] << 63)) & m[l];
+				}
+			}
+		} else {
+			for (u32 k = 0; k < stride; ++k) {
+				next[k] = src[k] & mask[k];
 			}
 		}
-		// PLAYER_MOVE_S
-		if (!(this_tile & WALL_FROM_N)) {
-			n_x = this.x; n_y = this.y - 1;
-			p = map_xyz(map, n_x, n_y, n_p);
-			if (!(*p & ALWAYS_BLOCKED_MASK)) {
-				to_explore[end++] = (struct to_explore) {
-					.x = n_x, .y = n_y, .period = n_p,
-				};
-				*p |= cost;
+	}
+}
+
+void step_puzzle_batch(struct puzzle_batch *batch, enum player_move *moves,
+                       enum move_response *results) {
+	u32 n = batch->num_lanes, h = batch->height;
+	u32 p_sx[BATCH_LANES], p_sy[BATCH_LANES];
+	enum move_response result[BATCH_LANES];
+	for (u32 l = 0; l < n; ++l) {
+		struct puzzle *puzzle = batch->puzzles[l];
+		p_sx[l] = puzzle->player.x; p_sy[l] = puzzle->player.y;
+		result[l] = moves ? step_player(puzzle, moves[l], NULL) : MOVE_RESPONSE_NONE;
+		++puzzle->tick;
+		for (u32 i = 0; i < puzzle->num_emitters; ++i) {
+			struct emitter *e = &puzzle->emitters[i];
+			u32 fired = step_emitter(e);
+			for (u32 d = 0; d < NUM_DIRS; ++d) {
+				if (fired & (1 << d)) {
+					lane_row(batch, d, e->y)[(e->x / 64)*BATCH_LANES + l] |= 1ull << (e->x % 64);
+				}
 			}
 		}
-		// PLAYER_MOVE_W
-		if (!(this_tile & WALL_FROM_E)) {
-			n_x = this.x + 1; n_y = this.y;
-			p = map_xyz(map, n_x, n_y, n_p);
-			if (!(*p & ALWAYS_BLOCKED_MASK)) {
-				to_explore[end++] = (struct to_explore) {
-					.x = n_x, .y = n_y, .period = n_p,
-				};
-				*p |= cost;
+	}
+	for (u32 d = 0; d < NUM_DIRS; ++d) {
+		shift_lanes(lane_row(batch, d, 0), batch->open, h, batch->words, dir_dx[d], dir_dy[d]);
+	}
+	// same hit and swap rules as step_puzzle_bitboard, lane by lane
+	for (u32 l = 0; l < n; ++l) {
+		struct puzzle *puzzle = batch->puzzles[l];
+		u32 w = puzzle->width, ph = puzzle->height;
+		u32 p_ex = puzzle->player.x, p_ey = puzzle->player.y;
+		if (p_ex < w && p_ey < ph) {
+			for (u32 d = 0; d < NUM_DIRS; ++d) {
+				u64 *word = &lane_row(batch, d, p_ey)[(p_ex / 64)*BATCH_LANES + l];
+				if (*word & (1ull << (p_ex % 64))) {
+					*word &= ~(1ull << (p_ex % 64));
+					result[l] = MOVE_RESPONSE_DEATH;
+				}
+				if (p_sx[l] - p_ex == (u32)dir_dx[d] && p_sy[l] - p_ey == (u32)dir_dy[d]) {
+					word = &lane_row(batch, d, p_sy[l])[(p_sx[l] / 64)*BATCH_LANES + l];
+					if (*word & (1ull << (p_sx[l] % 64))) {
+						*word &= ~(1ull << (p_sx[l] % 64));
+						result[l] = MOVE_RESPONSE_DEATH;
+					}
+				}
 			}
 		}
+		if (results != NULL) {
+			results[l] = result[l];
+		}
 	}
-	// printf("%u - %u\n", last_cost, end - last_cost_start);
-	struct goal result = {
-		.x = 0, .y = 0, .p = 0, .cost = 0, .others = 1000,
+}
+
+static const char *const move_names[] = {
+	[PLAYER_MOVE_PAUSE] = "Pause",
+	[PLAYER_MOVE_N]     = "N",
+	[PLAYER_MOVE_E]     = "E",
+	[PLAYER_MOVE_S]     = "S",
+	[PLAYER_MOVE_W]     = "W",
+};
+
+// Walks the cost field from the player down to the goal, taking map_hint's
+// move at each step.
+void solve_puzzle_map(struct solution *solution, struct puzzle *puzzle, struct map *map) {
+	static const s32 move_dx[] = {
+		[PLAYER_MOVE_N] = 0, [PLAYER_MOVE_E] = 1, [PLAYER_MOVE_S] = 0,
+		[PLAYER_MOVE_W] = -1, [PLAYER_MOVE_PAUSE] = 0,
 	};
-	if (end - last_cost_start > 0) {
-		u32 choice = rand() % (end - last_cost_start) + last_cost_start;
-		result = (struct goal) {
-			.x = to_explore[choice].x, .y = to_explore[choice].y,
-			.p = to_explore[choice].period, .cost = last_cost,
-			.others = last_cost_start - end,
-		};
+	static const s32 move_dy[] = {
+		[PLAYER_MOVE_N] = -1, [PLAYER_MOVE_E] = 0, [PLAYER_MOVE_S] = 1,
+		[PLAYER_MOVE_W] = 0, [PLAYER_MOVE_PAUSE] = 0,
+	};
+	FILE *trace = solution->trace;
+	free_map(map);
+	*map = generate_map(puzzle);
+	// too big to map: a solution but no cost field
+	if (!map->period) {
+		solve_puzzle_search(solution, puzzle);
+		return;
 	}
-	free(to_explore);
-	return result;
-}
+	track_map_paths(map);
+	solution->len = 0;
+	solution->paths = 0;
 
-void solve_puzzle(struct solution *solution, struct puzzle *puzzle) {
-	struct puzzle tmp;
-	memcpy(&tmp, puzzle, sizeof(tmp));
-	tmp.player.x = tmp.width + 1;
-	struct map map = generate_map(&tmp);
-
-	u32 goal_x = tmp.width + 1, goal_y = tmp.height + 1;
-	for (u32 j = 0; j < tmp.height; ++j) {
-		for (u32 i = 0; i < tmp.width; ++i) {
-			if (tmp.tiles[j*tmp.width + i] == TILE_GOAL) {
+	u32 goal_x = puzzle->width + 1, goal_y = puzzle->height + 1;
+	for (u32 j = 0; j < puzzle->height; ++j) {
+		for (u32 i = 0; i < puzzle->width; ++i) {
+			if (puzzle->tiles[j*puzzle->width + i] == TILE_GOAL) {
 				goal_x = i; goal_y = j;
 				goto found_goal;
 			}
 		}
 	}
 found_goal:
-	get_furthest_point(&map, goal_x + 1, goal_y + 1);
-	u32 cur_x = puzzle->player.x + 1, cur_y = puzzle->player.y + 1;
-	printf("goal: %u, %u\n", goal_x, goal_y);
-	printf("cur: %u, %u\n", cur_x, cur_y);
-	u32 num_moves = *map_xyz(&map, cur_x, cur_y, 0) & COST_MASK;
-	printf("num_moves: %u\n", num_moves);
-	if (num_moves == 0) {
-		goto err;
-	}
-	--num_moves;
-	u32 num_periods = map.period;
-	tmp.player.x = cur_x - 1; tmp.player.y = cur_y - 1;
-	solution->len = 0;
+	fill_map_costs(map, goal_x + 1, goal_y + 1);
+	u32 cur_x = puzzle->player.x, cur_y = puzzle->player.y;
+	struct hint hint = map_hint(map, cur_x, cur_y, 0);
+	solution->paths = map->paths[map_index(map, cur_x + 1, cur_y + 1, 0)];
+	if (trace) {
+		fprintf(trace, "goal: %u, %u\n", goal_x, goal_y);
+		fprintf(trace, "cur: %u, %u\n", cur_x, cur_y);
+		fprintf(trace, "num_moves: %u\n", hint.moves_left);
+		fprintf(trace, "shortest paths: %llu\n", (unsigned long long)solution->paths);
+	}
+	if (!hint.reachable) {
+		return;
+	}
+	u32 num_moves = hint.moves_left;
+	solution->moves = realloc(solution->moves, num_moves * sizeof(*solution->moves));
 	for (u32 i = 0; i < num_moves; ++i) {
-		struct puzzle tmp_reset;
-		memcpy(&tmp_reset, &tmp, sizeof(tmp));
-
-		u32 next_sol_num = num_moves - i;
-		u32 p = (i + 1) % num_periods;
-
-		printf("page: %u, next_sol_num: %x, cur: (%u, %u)\n", p, next_sol_num, cur_x, cur_y);
-		print_map_page(&map, p);
-
-		if (step_puzzle(&tmp, PLAYER_MOVE_PAUSE, NULL) != MOVE_RESPONSE_DEATH
-		 && ((*map_xyz(&map, cur_x, cur_y, p)) & COST_MASK) == next_sol_num) {
-			printf("Pause:\n");
-			print_puzzle(&tmp);
-			solution->moves[i] = PLAYER_MOVE_PAUSE;
-			++solution->len;
-			continue;
-		}
-
-		memcpy(&tmp, &tmp_reset, sizeof(tmp));
-		if (step_puzzle(&tmp, PLAYER_MOVE_N, NULL) != MOVE_RESPONSE_DEATH
-		 && ((*map_xyz(&map, cur_x, cur_y - 1, p)) & COST_MASK) == next_sol_num) {
-			--cur_y;
-			printf("N:\n");
-			print_puzzle(&tmp);
-			solution->moves[i] = PLAYER_MOVE_N;
-			++solution->len;
-			continue;
+		hint = map_hint(map, cur_x, cur_y, i);
+		if (trace) {
+			u32 p = (i + 1) % map->period;
+			fprintf(trace, "page: %u, next_sol_num: %x, cur: (%u, %u)\n",
+			        p, num_moves - i, cur_x, cur_y);
+			print_map_page(trace, map, p);
 		}
-
-		memcpy(&tmp, &tmp_reset, sizeof(tmp));
-		if (step_puzzle(&tmp, PLAYER_MOVE_E, NULL) != MOVE_RESPONSE_DEATH
-		 && ((*map_xyz(&map, cur_x + 1, cur_y, p)) & COST_MASK) == next_sol_num) {
-			++cur_x;
-			printf("E:\n");
-			print_puzzle(&tmp);
-			solution->moves[i] = PLAYER_MOVE_E;
-			++solution->len;
-			continue;
+		if (hint.moves_left != num_moves - i) {
+			if (trace) {
+				fprintf(trace, "ERROR! CODE RED!\n");
+			}
+			break;
 		}
-
-		memcpy(&tmp, &tmp_reset, sizeof(tmp));
-		if (step_puzzle(&tmp, PLAYER_MOVE_S, NULL) != MOVE_RESPONSE_DEATH
-		 && ((*map_xyz(&map, cur_x, cur_y + 1, p)) & COST_MASK) == next_sol_num) {
-			++cur_y;
-			printf("S:\n");
-			print_puzzle(&tmp);
-			solution->moves[i] = PLAYER_MOVE_S;
-			++solution->len;
-			continue;
+		cur_x += move_dx[hint.next]; cur_y += move_dy[hint.next];
+		solution->moves[solution->len++] = hint.next;
+		if (trace) {
+			fprintf(trace, "%s:\n", move_names[hint.next]);
 		}
+	}
 
-		memcpy(&tmp, &tmp_reset, sizeof(tmp));
-		if (step_puzzle(&tmp, PLAYER_MOVE_W, NULL) != MOVE_RESPONSE_DEATH
-		 && ((*map_xyz(&map, cur_x - 1, cur_y, p)) & COST_MASK) == next_sol_num) {
-			--cur_x;
-			printf("W:\n");
-			print_puzzle(&tmp);
-			solution->moves[i] = PLAYER_MOVE_W;
-			++solution->len;
-			continue;
+	if (trace) {
+		fprintf(trace, "solution len: %u\n", solution->len);
+		for (u32 i = 0; i < solution->len; ++i) {
+			fprintf(trace, "%s\n", move_names[solution->moves[i]]);
 		}
-
-		printf("ERROR! CODE RED!\n");
-		break;
 	}
+}
 
-	printf("solution len: %u\n", solution->len);
-	for (u32 i = 0; i < solution->len; ++i) {
-		switch (solution->moves[i]) {
-		case PLAYER_MOVE_PAUSE:
-			printf("Pause\n");
-			break;
-		case PLAYER_MOVE_N:
-			printf("N\n");
-			break;
-		case PLAYER_MOVE_E:
-			printf("E\n");
-			break;
-		case PLAYER_MOVE_S:
-			printf("S\n");
-			break;
-		case PLAYER_MOVE_W:
-			printf("W\n");
-			break;
-		}
+void solve_puzzle(struct solution *solution, struct puzzle *puzzle) {
+	if (map_states(puzzle) > SEARCH_MAP_STATES) {
+		solve_puzzle_search(solution, puzzle);
+		return;
 	}
+	struct map map = {};
+	solve_puzzle_map(solution, puzzle, &map);
+	free_map(&map);
+}
 
-err:
-	free(map.data);
+void free_solution(struct solution *solution) {
+	free(solution->moves);
+	memset(solution, 0, sizeof(*solution));
 }
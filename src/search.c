@@ -0,0 +1,468 @@
+#include "search.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "my_math.h"
+#include "puzzle.h"
+#include "stencil.h"
+
+// The moves in the order map_hint tries them, with the direction of the
+// bullet that forbids stepping against it, -1 for none.
+static const struct {
+	enum player_move move;
+	s32 dx, dy;
+	s32 against;
+} steps[] = {
+	{ PLAYER_MOVE_PAUSE,  0,  0, -1    },
+	{ PLAYER_MOVE_N,      0, -1, DIR_S },
+	{ PLAYER_MOVE_E,      1,  0, DIR_W },
+	{ PLAYER_MOVE_S,      0,  1, DIR_N },
+	{ PLAYER_MOVE_W,     -1,  0, DIR_E },
+};
+#define NUM_STEPS (sizeof(steps) / sizeof(steps[0]))
+
+// A state is cell y*width + x at tick t mod period, keyed t*width*height + cell.
+// Ticks stay below 2^32 even when the period doesn't: the search gives up
+// long before it would wrap.
+//
+// The board is read a tick at a time from pages built from the stencil when
+// first needed, planes words u64s long: blocked, then the cells bullets
+// travelling N, E, S and W have just left. num_pages of them are kept, page
+// t in slot t % num_pages, and building one throws out what was there.
+struct search {
+	struct puzzle *puzzle;
+	u32 width, height;
+	u64 period;
+	u32 goal_x, goal_y;
+	struct stencil stencil;
+	u32 words, num_pages;
+	u64 *walls;
+	u64 *page_tick;  // ~0 for a slot not built yet
+	u64 *pages;      // pages[(slot*5 + plane)*words]
+	u32 goal_period;
+	u32 *goal_wait;  // ticks from t until the goal is clear, ~0 if never
+	u64 expanded;
+};
+// A* bookkeeping: an open-addressed table of the states seen so far and a
+// binary heap of the ones still to expand, which may hold stale entries.
+struct node {
+	u64 key;  // ~0 for an empty slot
+	u32 g;
+	u8 move, closed;
+};
+
+struct open_entry {
+	u32 f, g;
+	u64 key;
+};
+
+struct astar {
+	u32 capacity, count;
+	struct node *nodes;
+	u32 heap_len, heap_cap;
+	struct open_entry *heap;
+};
+
+static void set_bit(u64 *plane, u32 i) {
+	plane[i / 64] |= 1ull << (i % 64);
+}
+
+static u64 *occupancy_page(struct search *s, u32 t) {
+	u32 slot = t % s->num_pages;
+	u64 *page = s->pages + (u64)slot * 5 * s->words;
+	if (s->page_tick[slot] == t) {
+		return page;
+	}
+	s->page_tick[slot] = t;
+	memcpy(page, s->walls, s->words * sizeof(*page));
+	memset(page + s->words, 0, 4 * s->words * sizeof(*page));
+	for (u32 r = 0; r < s->stencil.num_rays; ++r) {
+		struct ray *ray = &s->stencil.rays[r];
+		u32 *cells = s->stencil.cells + ray->first;
+		// diagonal bullets can't be walked into
+		u32 orthogonal = !(ray->dir & 1);
+		for (u32 m = 1; m <= ray->len; ++m) {
+			if (!ray_occupied(ray, t, m)) {
+				continue;
+			}
+			set_bit(page, cells[m - 1]);
+			if (orthogonal && m > 1) {
+				set_bit(page + (1 + ray->dir / 2) * s->words, cells[m - 2]);
+			}
+		}
+	}
+	return page;
+}
+
+static u32 page_bit(u64 *plane, u32 i) {
+	return (plane[i / 64] >> (i % 64)) & 1;
+}
+
+// Whether steps[k] from (x, y) lands on a free cell of page.
+static u32 can_step(struct search *s, u64 *page, u32 x, u32 y, u32 k) {
+	u32 nx = x + steps[k].dx, ny = y + steps[k].dy;
+	if (nx >= s->width || ny >= s->height) {
+		return 0;
+	}
+	u32 c = ny * s->width + nx;
+	if (page_bit(page, c)) {
+		return 0;
+	}
+	return steps[k].against < 0
+	    || !page_bit(page + (1 + steps[k].against / 2) * s->words, c);
+}
+
+static u32 heuristic(struct search *s, u32 x, u32 y, u32 t) {
+	u32 d = (x > s->goal_x ? x - s->goal_x : s->goal_x - x)
+	      + (y > s->goal_y ? y - s->goal_y : s->goal_y - y);
+	return d + s->goal_wait[((u64)t + d) % s->goal_period];
+}
+
+static u32 next_tick(struct search *s, u32 t) {
+	return t + 1 == s->period ? 0 : t + 1;
+}
+
+// The goal's own period is that of the rays crossing it. The wait is left at
+// 0 when that's longer than SEARCH_GOAL_PERIOD.
+static void goal_waits(struct search *s) {
+	u32 goal = s->goal_y * s->width + s->goal_x;
+	u64 period = 1;
+	for (u32 r = 0; r < s->stencil.num_rays; ++r) {
+		struct ray *ray = &s->stencil.rays[r];
+		for (u32 m = 1; m <= ray->len; ++m) {
+			if (s->stencil.cells[ray->first + m - 1] == goal) {
+				period = lcm_u64(period, ray->period);
+			}
+		}
+	}
+	if (period > SEARCH_GOAL_PERIOD) {
+		s->goal_period = 1;
+		s->goal_wait = calloc(1, sizeof(*s->goal_wait));
+		return;
+	}
+	s->goal_period = period;
+	s->goal_wait = malloc(period * sizeof(*s->goal_wait));
+	u32 wait = ~0u;
+	// two passes backwards carry the wait across the wrap
+	for (u32 pass = 0; pass < 2; ++pass) {
+		for (u32 t = period; t-- > 0;) {
+			u32 open = 1;
+			for (u32 r = 0; open && r < s->stencil.num_rays; ++r) {
+				struct ray *ray = &s->stencil.rays[r];
+				for (u32 m = 1; m <= ray->len; ++m) {
+					if (s->stencil.cells[ray->first + m - 1] == goal
+					 && ray_occupied(ray, t, m)) {
+						open = 0;
+						break;
+					}
+				}
+			}
+			if (open) {
+				wait = 0;
+			} else if (wait != ~0u) {
+				++wait;
+			}
+			s->goal_wait[t] = wait;
+		}
+	}
+}
+
+static void init_search(struct search *s, struct puzzle *puzzle) {
+	u32 w = puzzle->width, h = puzzle->height;
+	memset(s, 0, sizeof(*s));
+	s->puzzle = puzzle;
+	s->width = w; s->height = h;
+	s->goal_x = w; s->goal_y = h;
+	for (u32 i = 0; i < w * h; ++i) {
+		if (puzzle->tiles[i] == TILE_GOAL) {
+			s->goal_x = i % w; s->goal_y = i / w;
+			break;
+		}
+	}
+	build_stencil(&s->stencil, puzzle);
+	s->period = stencil_period(&s->stencil);
+	s->words = (w * h + 63) / 64;
+	s->walls = calloc(s->words, sizeof(*s->walls));
+	for (u32 i = 0; i < w * h; ++i) {
+		if (puzzle->tiles[i] == TILE_EMITTER || puzzle->tiles[i] == TILE_WALL) {
+			set_bit(s->walls, i);
+		}
+	}
+	u64 page_bytes = 5 * s->words * sizeof(*s->pages);
+	s->num_pages = MAX(SEARCH_PAGE_BYTES / page_bytes, 1);
+	s->num_pages = MIN(s->num_pages, s->period);
+	s->page_tick = malloc(s->num_pages * sizeof(*s->page_tick));
+	memset(s->page_tick, 0xFF, s->num_pages * sizeof(*s->page_tick));
+	s->pages = malloc(s->num_pages * page_bytes);
+	if (s->goal_x < w) {
+		goal_waits(s);
+	} else {
+		s->goal_period = 1;
+		s->goal_wait = malloc(sizeof(*s->goal_wait));
+		s->goal_wait[0] = ~0u;
+	}
+}
+
+static void free_search(struct search *s) {
+	free_stencil(&s->stencil);
+	free(s->walls);
+	free(s->page_tick);
+	free(s->pages);
+	free(s->goal_wait);
+	memset(s, 0, sizeof(*s));
+}
+
+static u32 hash_key(u64 key) {
+	key *= 0x9E3779B97F4A7C15ull;
+	return key >> 32;
+}
+
+static void grow_nodes(struct astar *a) {
+	u32 old_capacity = a->capacity;
+	struct node *old = a->nodes;
+	a->capacity = old_capacity ? 2 * old_capacity : 1024;
+	a->nodes = malloc(a->capacity * sizeof(*a->nodes));
+	memset(a->nodes, 0xFF, a->capacity * sizeof(*a->nodes));
+	for (u32 i = 0; i < old_capacity; ++i) {
+		if (old[i].key == ~0ull) {
+			continue;
+		}
+		u32 j = hash_key(old[i].key) & (a->capacity - 1);
+		while (a->nodes[j].key != ~0ull) {
+			j = (j + 1) & (a->capacity - 1);
+		}
+		a->nodes[j] = old[i];
+	}
+	free(old);
+}
+
+// The node for key, added with g = ~0 if it wasn't there. NULL once adding it
+// would take the table past SEARCH_MAX_STATES.
+static struct node *find_node(struct astar *a, u64 key) {
+	u32 j = 0;
+	if (a->capacity) {
+		j = hash_key(key) & (a->capacity - 1);
+		while (a->nodes[j].key != ~0ull) {
+			if (a->nodes[j].key == key) {
+				return &a->nodes[j];
+			}
+			j = (j + 1) & (a->capacity - 1);
+		}
+	}
+	if (a->count >= SEARCH_MAX_STATES) {
+		return NULL;
+	}
+	if (2 * (a->count + 1) > a->capacity) {
+		grow_nodes(a);
+		j = hash_key(key) & (a->capacity - 1);
+		while (a->nodes[j].key != ~0ull) {
+			j = (j + 1) & (a->capacity - 1);
+		}
+	}
+	struct node *node = &a->nodes[j];
+	node->key = key;
+	node->g = ~0u;
+	node->move = PLAYER_MOVE_PAUSE;
+	node->closed = 0;
+	++a->count;
+	return node;
+}
+
+// Lowest f first, then the deepest, which is nearest the goal.
+static u32 entry_before(struct open_entry *e1, struct open_entry *e2) {
+	return e1->f != e2->f ? e1->f < e2->f : e1->g > e2->g;
+}
+
+static void push_open(struct astar *a, u32 f, u32 g, u64 key) {
+	if (a->heap_len == a->heap_cap) {
+		a->heap_cap = a->heap_cap ? 2 * a->heap_cap : 1024;
+		a->heap = realloc(a->heap, a->heap_cap * sizeof(*a->heap));
+	}
+	struct open_entry e = { .f = f, .g = g, .key = key };
+	u32 i = a->heap_len++;
+	while (i > 0 && entry_before(&e, &a->heap[(i - 1) / 2])) {
+		a->heap[i] = a->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	a->heap[i] = e;
+}
+
+static struct open_entry pop_open(struct astar *a) {
+	struct open_entry top = a->heap[0];
+	struct open_entry e = a->heap[--a->heap_len];
+	u32 i = 0;
+	for (;;) {
+		u32 child = 2*i + 1;
+		if (child >= a->heap_len) {
+			break;
+		}
+		if (child + 1 < a->heap_len && entry_before(&a->heap[child + 1], &a->heap[child])) {
+			++child;
+		}
+		if (!entry_before(&a->heap[child], &e)) {
+			break;
+		}
+		a->heap[i] = a->heap[child];
+		i = child;
+	}
+	a->heap[i] = e;
+	return top;
+}
+
+static void free_astar(struct astar *a) {
+	free(a->nodes);
+	free(a->heap);
+	memset(a, 0, sizeof(*a));
+}
+
+// Returns 0 if it ran out of room before settling the question, otherwise
+// fills in the solution, leaving it empty if the goal can't be reached. The
+// heuristic is consistent, so a state is final once expanded.
+static u32 astar(struct search *s, struct solution *solution, u32 x, u32 y) {
+	u32 cells = s->width * s->height;
+	struct astar a = {};
+	u32 found = 0, done = 0;
+	u64 key = y * s->width + x;
+	struct node *node = find_node(&a, key);
+	node->g = 0;
+	push_open(&a, heuristic(s, x, y, 0), 0, key);
+	while (a.heap_len) {
+		struct open_entry e = pop_open(&a);
+		node = find_node(&a, e.key);
+		if (node->closed || e.g > node->g) {
+			continue;
+		}
+		node->closed = 1;
+		++s->expanded;
+		u32 c = e.key % cells, t = e.key / cells;
+		x = c % s->width; y = c / s->width;
+		if (x == s->goal_x && y == s->goal_y) {
+			key = e.key;
+			found = 1;
+			break;
+		}
+		u32 nt = next_tick(s, t);
+		u64 *page = occupancy_page(s, nt);
+		for (u32 k = 0; k < NUM_STEPS; ++k) {
+			if (!can_step(s, page, x, y, k)) {
+				continue;
+			}
+			u32 nx = x + steps[k].dx, ny = y + steps[k].dy;
+			u64 nkey = (u64)nt * cells + ny * s->width + nx;
+			struct node *next = find_node(&a, nkey);
+			if (next == NULL) {
+				goto out;
+			}
+			if (next->closed || e.g + 1 >= next->g) {
+				continue;
+			}
+			next->g = e.g + 1;
+			next->move = k;
+			push_open(&a, e.g + 1 + heuristic(s, nx, ny, nt), e.g + 1, nkey);
+		}
+	}
+	done = 1;
+	if (!found) {
+		goto out;
+	}
+	// walk the moves back to the start
+	node = find_node(&a, key);
+	solution->len = node->g;
+	solution->moves = realloc(solution->moves, solution->len * sizeof(*solution->moves));
+	for (u32 i = solution->len; i-- > 0;) {
+		u32 k = node->move;
+		u32 c = key % cells, t = key / cells;
+		solution->moves[i] = steps[k].move;
+		c -= steps[k].dy * (s32)s->width + steps[k].dx;
+		t = t ? t - 1 : s->period - 1;
+		key = (u64)t * cells + c;
+		node = find_node(&a, key);
+	}
+out:
+	free_astar(&a);
+	return done;
+}
+
+// Depth first below bound, recording the smallest f over it in next_bound.
+static u32 ida(struct search *s, struct solution *solution, u32 x, u32 y, u32 t,
+               u32 g, u32 bound, u32 *next_bound) {
+	u32 f = g + heuristic(s, x, y, t);
+	if (f > bound) {
+		*next_bound = MIN(*next_bound, f);
+		return 0;
+	}
+	if (x == s->goal_x && y == s->goal_y) {
+		solution->len = g;
+		return 1;
+	}
+	if (++s->expanded > SEARCH_IDA_NODES) {
+		return 0;
+	}
+	u32 nt = next_tick(s, t);
+	for (u32 k = 0; k < NUM_STEPS; ++k) {
+		// deeper calls may have thrown the page out
+		if (!can_step(s, occupancy_page(s, nt), x, y, k)) {
+			continue;
+		}
+		solution->moves[g] = steps[k].move;
+		if (ida(s, solution, x + steps[k].dx, y + steps[k].dy, nt,
+		        g + 1, bound, next_bound)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void solve_puzzle_search(struct solution *solution, struct puzzle *puzzle) {
+	FILE *trace = solution->trace;
+	struct search s;
+	init_search(&s, puzzle);
+	solution->len = 0;
+	solution->paths = 0;
+	u32 x = puzzle->player.x, y = puzzle->player.y;
+	if (trace) {
+		fprintf(trace, "goal: %u, %u\n", s.goal_x, s.goal_y);
+		fprintf(trace, "cur: %u, %u\n", x, y);
+		fprintf(trace, "period: %llu\n", (unsigned long long)s.period);
+	}
+	// standing still is a step onto the same cell
+	if (!can_step(&s, occupancy_page(&s, 0), x, y, 0) || s.goal_wait[0] == ~0u) {
+		goto done;
+	}
+	if (astar(&s, solution, x, y)) {
+		if (trace) {
+			fprintf(trace, "A*: %llu states expanded\n", (unsigned long long)s.expanded);
+		}
+		goto done;
+	}
+	if (trace) {
+		fprintf(trace, "A*: out of room after %llu states, trying IDA*\n",
+		        (unsigned long long)s.expanded);
+	}
+	s.expanded = 0;
+	u32 bound = heuristic(&s, x, y, 0);
+	for (;;) {
+		u32 next_bound = ~0u;
+		solution->moves = realloc(solution->moves, bound * sizeof(*solution->moves));
+		if (ida(&s, solution, x, y, 0, 0, bound, &next_bound)) {
+			break;
+		}
+		if (next_bound == ~0u || s.expanded > SEARCH_IDA_NODES) {
+			solution->len = 0;
+			break;
+		}
+		bound = next_bound;
+	}
+	if (trace) {
+		fprintf(trace, "IDA*: %llu states expanded, bound %u\n",
+		        (unsigned long long)s.expanded, bound);
+	}
+done:
+	if (trace) {
+		fprintf(trace, "solution len: %u\n", solution->len);
+	}
+	free_search(&s);
+}
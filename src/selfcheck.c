@@ -0,0 +1,839 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "my_math.h"
+#include "puzzle.h"
+#include "stencil.h"
+#include "map.h"
+#include "search.h"
+
+// Checks the faster paths against the ones they stand in for on random
+// boards: no SDL, exits with failure if any of them differ.
+
+#define BOARDS 1000
+#define STEPS  100
+
+// A random board with the player on a random empty cell.
+static void random_puzzle(struct puzzle *puzzle) {
+	u32 w = 3 + rand() % 30, h = 3 + rand() % 20;
+	generate_puzzle(puzzle, w, h, 1 + rand() % MIN(w * h / 4, 16));
+	u32 c;
+	do {
+		c = rand() % (w * h);
+	} while (puzzle->tiles[c] != TILE_EMPTY);
+	puzzle->player.x = c % w;
+	puzzle->player.y = c / w;
+}
+
+static void copy_puzzle(struct puzzle *dst, struct puzzle *src) {
+	struct puzzle_snapshot snapshot = {};
+	snapshot_puzzle(&snapshot, src);
+	restore_puzzle(dst, &snapshot);
+	free_snapshot(&snapshot);
+}
+
+static u32 same_puzzle(struct puzzle *a, struct puzzle *b) {
+	return a->player.x == b->player.x && a->player.y == b->player.y
+	    && a->tick == b->tick && a->num_bullets == b->num_bullets
+	    && !memcmp(a->occupancy, b->occupancy, a->width * a->height * sizeof(*a->occupancy));
+}
+
+// random_puzzle with a goal on another empty cell.
+static void random_goal_puzzle(struct puzzle *puzzle) {
+	random_puzzle(puzzle);
+	u32 w = puzzle->width, c;
+	do {
+		c = rand() % (w * puzzle->height);
+	} while (puzzle->tiles[c] != TILE_EMPTY || c == puzzle->player.y*w + puzzle->player.x);
+	puzzle->tiles[c] = TILE_GOAL;
+}
+
+// Whether the solution's moves, played through step_puzzle on a copy of the
+// puzzle, win on the last one and not before.
+static u32 replay_wins(struct puzzle *puzzle, struct solution *solution) {
+	struct puzzle copy = {};
+	copy_puzzle(&copy, puzzle);
+	u32 ok = solution->len > 0;
+	for (u32 i = 0; ok && i < solution->len; ++i) {
+		enum move_response response = step_puzzle(&copy, solution->moves[i], NULL);
+		ok = response == (i + 1 == solution->len ? MOVE_RESPONSE_VICTORY : MOVE_RESPONSE_NONE);
+	}
+	free_puzzle(&copy);
+	return ok;
+}
+
+// step_puzzle_bitboard against step_puzzle.
+static u32 check_bitboard(void) {
+	struct puzzle ref = {}, puzzle = {};
+	struct bitboard board = {};
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS; ++i) {
+		random_puzzle(&ref);
+		copy_puzzle(&puzzle, &ref);
+		bitboard_from_puzzle(&board, &puzzle);
+		for (u32 s = 0; s < STEPS; ++s) {
+			enum player_move move = rand() % 5;
+			enum move_response expected = step_puzzle(&ref, move, NULL);
+			enum move_response response = step_puzzle_bitboard(&puzzle, &board, move, NULL);
+			bitboard_to_puzzle(&puzzle, &board);
+			if (response != expected || !same_puzzle(&ref, &puzzle)) {
+				printf("bitboard: board %u differs after step %u\n", i, s);
+				ok = 0;
+				break;
+			}
+			if (expected != MOVE_RESPONSE_NONE) {
+				break;
+			}
+		}
+	}
+	free_bitboard(&board);
+	free_puzzle(&puzzle);
+	free_puzzle(&ref);
+	return ok;
+}
+
+// step_puzzle_batch against step_puzzle on each lane, the lanes sometimes
+// copies of one board as the batch is meant to be used.
+static u32 check_batch(void) {
+	struct puzzle ref[BATCH_LANES] = {}, puzzles[BATCH_LANES] = {};
+	struct puzzle *lanes[BATCH_LANES];
+	struct puzzle_batch batch = {};
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS / 4; ++i) {
+		u32 n = 1 + rand() % BATCH_LANES, copies = rand() & 1;
+		for (u32 l = 0; l < n; ++l) {
+			if (copies && l) {
+				copy_puzzle(&ref[l], &ref[0]);
+			} else {
+				random_puzzle(&ref[l]);
+			}
+			copy_puzzle(&puzzles[l], &ref[l]);
+			lanes[l] = &puzzles[l];
+		}
+		batch_from_puzzles(&batch, lanes, n);
+		for (u32 s = 0, done = 0; !done && s < STEPS; ++s) {
+			enum player_move moves[BATCH_LANES];
+			enum move_response expected[BATCH_LANES], results[BATCH_LANES];
+			// now and then the moves-free pause
+			u32 pause = rand() % 8 == 0;
+			for (u32 l = 0; l < n; ++l) {
+				moves[l] = pause ? PLAYER_MOVE_PAUSE : rand() % 5;
+				expected[l] = step_puzzle(&ref[l], moves[l], NULL);
+			}
+			step_puzzle_batch(&batch, pause ? NULL : moves, results);
+			batch_to_puzzles(&batch);
+			for (u32 l = 0; l < n; ++l) {
+				if (results[l] != expected[l] || !same_puzzle(&ref[l], &puzzles[l])) {
+					printf("batch: lane %u of board %u differs after step %u\n", l, i, s);
+					ok = 0;
+					done = 1;
+					break;
+				}
+				// a lane that has ended can't go on
+				done |= expected[l] != MOVE_RESPONSE_NONE;
+			}
+		}
+	}
+	free_batch(&batch);
+	for (u32 l = 0; l < BATCH_LANES; ++l) {
+		free_puzzle(&ref[l]);
+		free_puzzle(&puzzles[l]);
+	}
+	return ok;
+}
+
+// A snapshot restored after the puzzle has been played on against the puzzle
+// as it was, kept by copying its arrays: tiles, emitters to the step they are
+// on, player, tick and bullets. Some boards get walls, which the snapshot
+// keeps as bits of their own.
+static u32 check_snapshots(void) {
+	struct puzzle puzzle = {}, kept = {};
+	struct puzzle_snapshot snapshot = {}, copy = {};
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS; ++i) {
+		random_goal_puzzle(&puzzle);
+		u32 w = puzzle.width, h = puzzle.height, cells = w * h;
+		if (rand() & 1) {
+			for (u32 k = cells / 8; k > 0; --k) {
+				u32 c = rand() % cells;
+				if (puzzle.tiles[c] == TILE_EMPTY && c != puzzle.player.y*w + puzzle.player.x) {
+					puzzle.tiles[c] = TILE_WALL;
+				}
+			}
+			steady_state_bullets(&puzzle);
+		}
+		puzzle.tick = rand() % 1000;
+		resize_puzzle(&kept, w, h, puzzle.num_emitters);
+		kept.player = puzzle.player;
+		kept.tick = puzzle.tick;
+		kept.num_bullets = puzzle.num_bullets;
+		memcpy(kept.tiles, puzzle.tiles, cells * sizeof(*kept.tiles));
+		memcpy(kept.occupancy, puzzle.occupancy, cells * sizeof(*kept.occupancy));
+		memcpy(kept.emitters, puzzle.emitters, puzzle.num_emitters * sizeof(*kept.emitters));
+		// restore from a copy of a snapshot that has since been taken again
+		snapshot_puzzle(&snapshot, &puzzle);
+		copy_snapshot(&copy, &snapshot);
+		for (u32 s = rand() % STEPS; s > 0; --s) {
+			if (step_puzzle(&puzzle, rand() % 5, NULL) != MOVE_RESPONSE_NONE) {
+				break;
+			}
+		}
+		snapshot_puzzle(&snapshot, &puzzle);
+		restore_puzzle(&puzzle, &copy);
+		if (!same_puzzle(&puzzle, &kept)
+		 || memcmp(puzzle.tiles, kept.tiles, cells * sizeof(*kept.tiles))
+		 || memcmp(puzzle.emitters, kept.emitters, kept.num_emitters * sizeof(*kept.emitters))) {
+			printf("snapshots: board %u differs after restoring\n", i);
+			ok = 0;
+		}
+	}
+	free_snapshot(&snapshot);
+	free_snapshot(&copy);
+	free_puzzle(&kept);
+	free_puzzle(&puzzle);
+	return ok;
+}
+
+// The game's undo: a base snapshot that the oldest move is folded into once
+// more than SEEK_WINDOW moves are kept, and seek_puzzle from it with the
+// player put back where the history has it. Seeking to a random kept tick has
+// to give the puzzle that replaying the moves from the start gives.
+#define SEEK_WINDOW 16
+static u32 check_seek(void) {
+	struct puzzle puzzle = {}, seeked = {}, replay = {};
+	struct puzzle_snapshot reset = {}, base = {};
+	enum player_move moves[STEPS];
+	struct {
+		u32 x, y;
+	} history[STEPS + 1];
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS / 4; ++i) {
+		random_goal_puzzle(&puzzle);
+		snapshot_puzzle(&reset, &puzzle);
+		copy_snapshot(&base, &reset);
+		history[0].x = puzzle.player.x;
+		history[0].y = puzzle.player.y;
+		u32 base_tick = 0, last = 0;
+		for (u32 tick = 1; tick <= STEPS; ++tick) {
+			if (tick - base_tick == SEEK_WINDOW) {
+				advance_snapshot(&base, 1);
+				++base_tick;
+				base.player_x = history[base_tick].x;
+				base.player_y = history[base_tick].y;
+			}
+			moves[tick - 1] = rand() % 5;
+			enum move_response response = step_puzzle(&puzzle, moves[tick - 1], NULL);
+			history[tick].x = puzzle.player.x;
+			history[tick].y = puzzle.player.y;
+			// the move that ends the attempt can take a bullet with it,
+			// which seeking doesn't show
+			if (response != MOVE_RESPONSE_NONE) {
+				break;
+			}
+			last = tick;
+		}
+		for (u32 k = 0; ok && last >= base_tick && k < 4; ++k) {
+			u32 tick = base_tick + rand() % (last - base_tick + 1);
+			seek_puzzle(&seeked, &base, tick - base_tick);
+			seeked.player.x = history[tick].x;
+			seeked.player.y = history[tick].y;
+			restore_puzzle(&replay, &reset);
+			for (u32 t = 0; t < tick; ++t) {
+				step_puzzle(&replay, moves[t], NULL);
+			}
+			if (!same_puzzle(&seeked, &replay)
+			 || memcmp(seeked.emitters, replay.emitters,
+			           replay.num_emitters * sizeof(*replay.emitters))) {
+				printf("seek: board %u differs at tick %u from base tick %u\n",
+				       i, tick, base_tick);
+				ok = 0;
+			}
+		}
+	}
+	free_snapshot(&reset);
+	free_snapshot(&base);
+	free_puzzle(&replay);
+	free_puzzle(&seeked);
+	free_puzzle(&puzzle);
+	return ok;
+}
+
+// bullet_density against pausing the board through its period and counting
+// the ticks each cell has a bullet on. Generated emitters all repeat within 24
+// ticks, so every other board gets fixed emitters of 5 to 13 steps instead,
+// where crossing rays take a cell past the 64-tick mask to the tick count.
+static u32 check_density(void) {
+	static const u32 long_steps[] = { 5, 7, 9, 11, 13 };
+	struct puzzle puzzle = {};
+	struct stencil stencil = {};
+	u32 ok = 1, counted = 0;
+	for (u32 i = 0; ok && i < BOARDS / 10; ++i) {
+		u32 w = 3 + rand() % 14, h = 3 + rand() % 14;
+		generate_puzzle(&puzzle, w, h, 1 + rand() % MIN(w * h / 4, 8));
+		if (i & 1) {
+			for (u32 j = 0; j < puzzle.num_emitters; ++j) {
+				struct emitter *e = &puzzle.emitters[j];
+				e->type      = EMITTER_FIXED;
+				e->num_steps = long_steps[rand() % 5];
+				e->fire_mask = 1 + rand() % ((1 << e->num_steps) - 1);
+				e->step      = 1 + rand() % e->num_steps;
+			}
+			steady_state_bullets(&puzzle);
+		}
+		u32 cells = w * h;
+		f32 *density = malloc(cells * sizeof(*density));
+		u64 *period = malloc(cells * sizeof(*period));
+		u32 *ticks = calloc(cells, sizeof(*ticks));
+		bullet_density(&puzzle, density);
+		build_stencil(&stencil, &puzzle);
+		for (u32 c = 0; c < cells; ++c) {
+			period[c] = 1;
+		}
+		for (u32 r = 0; r < stencil.num_rays; ++r) {
+			struct ray *ray = &stencil.rays[r];
+			for (u32 m = 0; m < ray->len; ++m) {
+				u32 c = stencil.cells[ray->first + m];
+				period[c] = lcm_u64(period[c], ray->period);
+			}
+		}
+		u64 board_period = stencil_period(&stencil);
+		for (u64 t = 0; t < board_period; ++t) {
+			for (u32 c = 0; c < cells; ++c) {
+				ticks[c] += puzzle.occupancy[c] != 0;
+			}
+			step_puzzle_headless(&puzzle);
+		}
+		for (u32 c = 0; ok && c < cells; ++c) {
+			if (puzzle.tiles[c] != TILE_EMPTY) {
+				continue;
+			}
+			f32 diff = density[c] - (f32)ticks[c] / board_period;
+			if (diff > 1e-5f || diff < -1e-5f) {
+				printf("density: board %u, (%u, %u) has %f where the board has %u of %llu ticks\n",
+				       i, c % w, c / w, density[c], ticks[c], (unsigned long long)board_period);
+				ok = 0;
+			}
+			counted += period[c] > 64;
+		}
+		free_stencil(&stencil);
+		free(density);
+		free(period);
+		free(ticks);
+	}
+	if (ok && !counted) {
+		printf("density: no cell needed more than the 64-tick mask\n");
+		ok = 0;
+	}
+	free_puzzle(&puzzle);
+	return ok;
+}
+
+// Whether a's planes match b's, b's period dividing a's.
+static u32 same_planes(struct map *a, struct map *b) {
+	u32 page = a->page_words * 64;
+	for (u32 i = 0; i < a->size; ++i) {
+		u32 j = (i / page) % b->period * page + i % page;
+		if (map_plane_bit(a, a->blocked, i) != map_plane_bit(b, b->blocked, j)) {
+			return 0;
+		}
+		for (u32 f = 0; f < NUM_FROM; ++f) {
+			if (map_plane_bit(a, a->from[f], i) != map_plane_bit(b, b->from[f], j)) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+// remove_map_emitter and add_map_emitter against a fresh generate_map, over
+// a run of retunes of one board's emitters.
+static u32 check_emitter_edits(void) {
+	static const u32 step_lengths[] = { 1, 2, 3, 4, 6, 8 };
+	struct puzzle puzzle = {};
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS / 10; ++i) {
+		random_puzzle(&puzzle);
+		struct map map = generate_map(&puzzle);
+		for (u32 s = 0; map.period && s < 10; ++s) {
+			u32 k = rand() % puzzle.num_emitters;
+			struct emitter *e = &puzzle.emitters[k];
+			remove_map_emitter(&map, &puzzle, k);
+			e->type      = rand() % 3;
+			e->dir_mask  = rand() & 0xFF;
+			e->num_steps = step_lengths[rand() % 6];
+			e->step      = 1 + rand() % e->num_steps;
+			e->fire_mask = rand() & ((1 << e->num_steps) - 1);
+			u32 fits = add_map_emitter(&map, &puzzle, k);
+			struct map fresh = generate_map(&puzzle);
+			if (!fits) {
+				// the map's period is too short for the new firing
+				free_map(&map);
+				map = fresh;
+				continue;
+			}
+			if (!same_planes(&map, &fresh)) {
+				printf("emitter edits: board %u differs after edit %u\n", i, s);
+				ok = 0;
+			}
+			free_map(&fresh);
+			if (!ok) {
+				break;
+			}
+		}
+		free_map(&map);
+	}
+	free_puzzle(&puzzle);
+	return ok;
+}
+
+// generate_map's planes against the puzzle paused through its period: page p
+// is the board p ticks on, blocked where a wall, emitter or bullet is and
+// from behind each bullet moving N, E, S or W. Some boards get walls too,
+// with the bullets laid down again around them.
+static u32 check_map_planes(void) {
+	static const s32 from_plane[NUM_DIRS] = {
+		FROM_N, -1, FROM_E, -1, FROM_S, -1, FROM_W, -1,
+	};
+	struct puzzle puzzle = {}, walled = {};
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS / 4; ++i) {
+		random_puzzle(&puzzle);
+		u32 w = puzzle.width, h = puzzle.height;
+		for (u32 k = rand() % 4 ? 0 : w * h / 8; k > 0; --k) {
+			u32 c = rand() % (w * h);
+			if (puzzle.tiles[c] == TILE_EMPTY) {
+				puzzle.tiles[c] = TILE_WALL;
+			}
+		}
+		copy_puzzle(&walled, &puzzle);
+		walled.player.x = w + 1;
+		walled.player.y = h + 1;
+		struct map map = generate_map(&walled);
+		for (u32 p = 0; ok && p < map.period; ++p) {
+			for (u32 y = 0; y < map.height; ++y) {
+				for (u32 x = 0; x < map.width; ++x) {
+					u32 blocked = 1, from[NUM_FROM] = {};
+					if (x && y && x <= w && y <= h) {
+						enum tile tile = walled.tiles[(y - 1)*w + x - 1];
+						blocked = tile == TILE_WALL || tile == TILE_EMITTER
+						       || bullets_at(&walled, x - 1, y - 1);
+					}
+					for (u32 d = 0; d < NUM_DIRS; ++d) {
+						if (from_plane[d] >= 0
+						 && (bullets_at(&walled, x - 1 + dir_dx[d], y - 1 + dir_dy[d]) >> d) & 1) {
+							from[from_plane[d]] = 1;
+						}
+					}
+					u32 c = map_index(&map, x, y, p);
+					u32 same = map_plane_bit(&map, map.blocked, c) == blocked;
+					for (u32 f = 0; f < NUM_FROM; ++f) {
+						same &= map_plane_bit(&map, map.from[f], c) == from[f];
+					}
+					if (!same) {
+						printf("map planes: board %u differs at (%u, %u) on page %u\n",
+						       i, x, y, p);
+						ok = 0;
+						goto next_board;
+					}
+				}
+			}
+			step_puzzle_headless(&walled);
+		}
+	next_board:
+		free_map(&map);
+	}
+	free_puzzle(&walled);
+	free_puzzle(&puzzle);
+	return ok;
+}
+
+// A plain queue BFS back from (x, y) over every state of the map, the way
+// fill_map_costs counts: 1 on the start's open states, and a state one tick
+// earlier is one more if it pauses into, or steps without a bullet leaving
+// the target towards it, a state already counted. Returns the largest cost.
+static u32 reference_costs(struct map *map, u32 x, u32 y, u32 *costs) {
+	u32 w = map->width, page = map->page_words * 64, period = map->period;
+	u32 *queue = malloc(map->size * sizeof(*queue)), head = 0, tail = 0, furthest = 0;
+	memset(costs, 0, map->size * sizeof(*costs));
+	for (u32 p = 0; p < period; ++p) {
+		u32 c = map_index(map, x, y, p);
+		if (!map_plane_bit(map, map->blocked, c)) {
+			costs[c] = 1;
+			queue[tail++] = c;
+		}
+	}
+	while (head < tail) {
+		u32 s = queue[head++], p = s / page, c = s % page;
+		u32 pp = p ? p - 1 : period - 1;
+		// where the player was on pp, and the from plane that would forbid it
+		u32 before[5] = { c, c + w, c - 1, c - w, c + 1 };
+		s32 plane[5] = { -1, FROM_S, FROM_W, FROM_N, FROM_E };
+		furthest = MAX(furthest, costs[s]);
+		for (u32 k = 0; k < 5; ++k) {
+			u32 b = pp*page + before[k];
+			if (before[k] >= page || map_plane_bit(map, map->blocked, b) || costs[b]
+			 || (plane[k] >= 0 && map_plane_bit(map, map->from[plane[k]], s))) {
+				continue;
+			}
+			costs[b] = costs[s] + 1;
+			queue[tail++] = b;
+		}
+	}
+	free(queue);
+	return furthest;
+}
+
+// fill_map_costs' bitset BFS against reference_costs, state by state.
+static u32 check_costs(void) {
+	struct puzzle puzzle = {};
+	u32 *costs = NULL;
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS / 4; ++i) {
+		random_puzzle(&puzzle);
+		struct map map = generate_map(&puzzle);
+		costs = realloc(costs, map.size * sizeof(*costs));
+		for (u32 k = 0; ok && k < 4; ++k) {
+			u32 x = 1 + rand() % puzzle.width, y = 1 + rand() % puzzle.height;
+			reset_map(&map);
+			u32 furthest = fill_map_costs(&map, x, y);
+			ok = reference_costs(&map, x, y, costs) == furthest;
+			for (u32 c = 0; ok && c < map.size; ++c) {
+				ok = map_cost(&map, c) == costs[c];
+			}
+			if (!ok) {
+				printf("costs: board %u differs from (%u, %u)\n", i, x, y);
+			}
+		}
+		free_map(&map);
+	}
+	free(costs);
+	free_puzzle(&puzzle);
+	return ok;
+}
+
+// furthest_costs' 64 starts at a time against fill_map_costs from each cell.
+static u32 check_furthest_costs(void) {
+	struct puzzle puzzle = {};
+	u32 *costs = NULL;
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS / 20; ++i) {
+		random_puzzle(&puzzle);
+		struct map map = generate_map(&puzzle);
+		costs = realloc(costs, map.width * map.height * sizeof(*costs));
+		furthest_costs(&map, costs);
+		for (u32 y = 0; ok && y < map.height; ++y) {
+			for (u32 x = 0; ok && x < map.width; ++x) {
+				reset_map(&map);
+				if (costs[y*map.width + x] != fill_map_costs(&map, x, y)) {
+					printf("furthest costs: board %u differs at (%u, %u)\n", i, x, y);
+					ok = 0;
+				}
+			}
+		}
+		free_map(&map);
+	}
+	free(costs);
+	free_puzzle(&puzzle);
+	return ok;
+}
+
+// Solutions walked down the cost field by solve_puzzle_map are as long as the
+// cost at the start says, and win when replayed.
+static u32 check_map_solutions(void) {
+	struct puzzle puzzle = {};
+	struct solution solution = {};
+	struct map map = {};
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS / 4; ++i) {
+		random_goal_puzzle(&puzzle);
+		solve_puzzle_map(&solution, &puzzle, &map);
+		struct hint hint = map_hint(&map, puzzle.player.x, puzzle.player.y, 0);
+		if (!hint.reachable) {
+			ok = !solution.len;
+		} else {
+			ok = solution.len == hint.moves_left && replay_wins(&puzzle, &solution);
+		}
+		if (!ok) {
+			printf("map solutions: board %u, %u moves for a cost of %u\n",
+			       i, solution.len, hint.reachable ? hint.moves_left : 0);
+		}
+	}
+	free_map(&map);
+	free_solution(&solution);
+	free_puzzle(&puzzle);
+	return ok;
+}
+
+// The states a pause or a step N, E, S or W from state s lands on, the
+// legal ones first; returns how many are legal.
+static u32 forward_moves(struct map *map, u32 s, u32 to[5]) {
+	u32 w = map->width, page = map->page_words * 64;
+	u32 p = s / page, c = s % page, np = p + 1 == map->period ? 0 : p + 1;
+	u32 cells[5] = { c, c - w, c + 1, c + w, c - 1 };
+	s32 plane[5] = { -1, FROM_S, FROM_W, FROM_N, FROM_E };
+	u32 n = 0;
+	for (u32 k = 0; k < 5; ++k) {
+		u32 t = np*page + cells[k];
+		if (cells[k] >= page || map_plane_bit(map, map->blocked, t)
+		 || (plane[k] >= 0 && map_plane_bit(map, map->from[plane[k]], t))) {
+			continue;
+		}
+		to[n++] = t;
+	}
+	return n;
+}
+
+// Move sequences of exactly moves steps forward from state s that end on a
+// state of cost 1, tried one by one.
+static u64 enumerate_paths(struct map *map, u32 s, u32 moves) {
+	if (!moves) {
+		return map_cost(map, s) == 1;
+	}
+	u32 to[5], n = forward_moves(map, s, to);
+	u64 total = 0;
+	for (u32 k = 0; k < n; ++k) {
+		total += enumerate_paths(map, to[k], moves - 1);
+	}
+	return total;
+}
+
+// The counts again in cost order from the successors one cost lower, adding
+// with saturation at 2^64 - 1; the map's costs must already be filled in.
+static void reference_paths(struct map *map, u64 *paths) {
+	u32 w = map->width, page = map->page_words * 64, furthest = 0;
+	for (u32 s = 0; s < map->size; ++s) {
+		furthest = MAX(furthest, map_cost(map, s));
+	}
+	for (u32 cost = 1; cost <= furthest; ++cost) {
+		for (u32 s = 0; s < map->size; ++s) {
+			if (map_cost(map, s) != cost) {
+				continue;
+			}
+			if (cost == 1) {
+				paths[s] = 1;
+				continue;
+			}
+			u32 p = s / page, c = s % page, np = p + 1 == map->period ? 0 : p + 1;
+			u32 to[5] = { c, c - w, c + 1, c + w, c - 1 };
+			s32 plane[5] = { -1, FROM_S, FROM_W, FROM_N, FROM_E };
+			paths[s] = 0;
+			for (u32 k = 0; k < 5; ++k) {
+				u32 t = np*page + to[k];
+				if (to[k] >= page || map_cost(map, t) != cost - 1
+				 || (plane[k] >= 0 && map_plane_bit(map, map->from[plane[k]], t))) {
+					continue;
+				}
+				paths[s] = paths[s] + paths[t] < paths[s] ? ~0ull : paths[s] + paths[t];
+			}
+		}
+	}
+}
+
+// The shortest path counts kept by the BFS against enumerate_paths, on tiny
+// boards and states close enough to the start to enumerate.
+static u32 check_path_counts(void) {
+	struct puzzle puzzle = {};
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS / 10; ++i) {
+		u32 w = 2 + rand() % 4, h = 2 + rand() % 4;
+		generate_puzzle(&puzzle, w, h, 1 + rand() % 2);
+		struct map map = generate_map(&puzzle);
+		track_map_paths(&map);
+		fill_map_costs(&map, 1 + rand() % w, 1 + rand() % h);
+		for (u32 s = 0; ok && s < map.size; ++s) {
+			u32 cost = map_cost(&map, s);
+			if (!cost || cost > 9) {
+				continue;
+			}
+			u64 paths = enumerate_paths(&map, s, cost - 1);
+			if (map.paths[s] != paths) {
+				printf("path counts: board %u, state %u has %llu, not %llu\n", i, s,
+				       (unsigned long long)map.paths[s], (unsigned long long)paths);
+				ok = 0;
+			}
+		}
+		free_map(&map);
+	}
+	// and against reference_paths on open boards, where counts saturate
+	u64 *paths = NULL;
+	for (u32 i = 0; ok && i < BOARDS / 100; ++i) {
+		u32 w = 48 + rand() % 16, h = 48 + rand() % 16;
+		generate_puzzle(&puzzle, w, h, 1);
+		struct map map = generate_map(&puzzle);
+		track_map_paths(&map);
+		fill_map_costs(&map, 1 + rand() % w, 1 + rand() % h);
+		paths = realloc(paths, map.size * sizeof(*paths));
+		reference_paths(&map, paths);
+		for (u32 s = 0; ok && s < map.size; ++s) {
+			if (map_cost(&map, s) && map.paths[s] != paths[s]) {
+				printf("path counts: open board %u, state %u has %llu, not %llu\n", i, s,
+				       (unsigned long long)map.paths[s], (unsigned long long)paths[s]);
+				ok = 0;
+			}
+		}
+		free_map(&map);
+	}
+	free(paths);
+	free_puzzle(&puzzle);
+	return ok;
+}
+
+// find_map_regions against forward reachability on tiny maps: two open
+// states share a region exactly when each reaches the other, and a sink
+// region reaches nothing outside itself.
+static u32 check_regions(void) {
+	struct puzzle puzzle = {};
+	struct map_regions regions = {};
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS / 10; ++i) {
+		u32 w = 2 + rand() % 5, h = 2 + rand() % 5;
+		generate_puzzle(&puzzle, w, h, 1 + rand() % 3);
+		struct map map = generate_map(&puzzle);
+		find_map_regions(&regions, &map);
+		u32 n = map.size, words = (n + 63) / 64;
+		// reach[s*words ...]: the states s can get to, itself included
+		u64 *reach = calloc((u64)n * words, sizeof(*reach));
+		u32 *queue = malloc(n * sizeof(*queue));
+		u32 open = 0, largest = 0, num_regions = 0, num_sinks = 0, sink_states = 0;
+		for (u32 s = 0; s < n; ++s) {
+			if (map_plane_bit(&map, map.blocked, s)) {
+				continue;
+			}
+			++open;
+			u64 *r = reach + (u64)s * words;
+			u32 head = 0, tail = 0;
+			r[s / 64] |= 1ull << (s % 64);
+			queue[tail++] = s;
+			while (head < tail) {
+				u32 to[5], m = forward_moves(&map, queue[head++], to);
+				for (u32 k = 0; k < m; ++k) {
+					if (!map_bit(r, to[k])) {
+						r[to[k] / 64] |= 1ull << (to[k] % 64);
+						queue[tail++] = to[k];
+					}
+				}
+			}
+		}
+		for (u32 s = 0; ok && s < n; ++s) {
+			if (map_plane_bit(&map, map.blocked, s)) {
+				ok = regions.region[s] == ~0u;
+				continue;
+			}
+			u32 size = 0, sink = 1;
+			for (u32 t = 0; ok && t < n; ++t) {
+				if (!map_bit(reach + (u64)s * words, t)) {
+					continue;
+				}
+				u32 mutual = map_bit(reach + (u64)t * words, s);
+				size += mutual;
+				sink &= mutual;
+				ok = mutual == (regions.region[s] == regions.region[t]);
+			}
+			ok = ok && regions.sizes[regions.region[s]] == size;
+			largest = MAX(largest, size);
+			// count each region once, at its lowest state
+			u32 first = 1;
+			for (u32 t = 0; first && t < s; ++t) {
+				first = regions.region[t] != regions.region[s];
+			}
+			num_regions += first;
+			num_sinks += sink && first;
+			sink_states += sink;
+		}
+		ok = ok && regions.num_regions == num_regions
+		  && regions.num_states == open && regions.largest == largest
+		  && regions.num_sinks == num_sinks && regions.sink_states == sink_states;
+		if (!ok) {
+			printf("regions: board %u differs\n", i);
+		}
+		free(queue);
+		free(reach);
+		free_map(&map);
+	}
+	free_map_regions(&regions);
+	free_puzzle(&puzzle);
+	return ok;
+}
+
+// make check also builds the search with A* cut to a handful of states, so
+// the IDA* fallback takes over. That only finishes quickly on short
+// solutions, and can't tell an unreachable goal from a far one short of
+// SEARCH_IDA_NODES expansions, so it only gets boards the map can solve in a
+// few moves.
+#if SEARCH_MAX_STATES < 1024
+#define IDA_MAX_MOVES 24
+#else
+#define IDA_MAX_MOVES 0
+#endif
+
+// solve_puzzle_search against solve_puzzle_map's length, its moves replayed
+// to a win.
+static u32 check_search(void) {
+	struct puzzle puzzle = {};
+	struct solution expected = {}, found = {};
+	struct map map = {};
+	u32 ok = 1;
+	for (u32 i = 0; ok && i < BOARDS / 4; ++i) {
+		u32 w = 3 + rand() % 6, h = 3 + rand() % 5;
+		generate_puzzle(&puzzle, w, h, 1 + rand() % 3);
+		u32 c;
+		do {
+			c = rand() % (w * h);
+		} while (puzzle.tiles[c] != TILE_EMPTY);
+		puzzle.player.x = c % w;
+		puzzle.player.y = c / w;
+		do {
+			c = rand() % (w * h);
+		} while (puzzle.tiles[c] != TILE_EMPTY || c == puzzle.player.y*w + puzzle.player.x);
+		puzzle.tiles[c] = TILE_GOAL;
+		solve_puzzle_map(&expected, &puzzle, &map);
+		if (IDA_MAX_MOVES && (!expected.len || expected.len > IDA_MAX_MOVES)) {
+			continue;
+		}
+		solve_puzzle_search(&found, &puzzle);
+		ok = found.len == expected.len && (!found.len || replay_wins(&puzzle, &found));
+		if (!ok) {
+			printf("search: board %u, %u moves where the map takes %u\n",
+			       i, found.len, expected.len);
+		}
+	}
+	free_map(&map);
+	free_solution(&expected);
+	free_solution(&found);
+	free_puzzle(&puzzle);
+	return ok;
+}
+
+int main(s32 argc, char *argv[]) {
+	u32 seed = argc > 1 ? strtoul(argv[1], NULL, 0) : time(NULL);
+	printf("Random seed: 0x%x\n", seed);
+	srand(seed);
+	static const struct {
+		const char *name;
+		u32 (*run)(void);
+	} checks[] = {
+		{ "bitboard",       check_bitboard       },
+		{ "batch",          check_batch          },
+		{ "density",        check_density        },
+		{ "snapshots",      check_snapshots      },
+		{ "seek",           check_seek           },
+		{ "emitter edits",  check_emitter_edits  },
+		{ "map planes",     check_map_planes     },
+		{ "costs",          check_costs          },
+		{ "furthest costs", check_furthest_costs },
+		{ "map solutions",  check_map_solutions  },
+		{ "path counts",    check_path_counts    },
+		{ "regions",        check_regions        },
+		{ "search",         check_search         },
+	};
+	u32 failed = 0;
+	for (u32 i = 0; i < sizeof(checks) / sizeof(checks[0]); ++i) {
+		u32 ok = checks[i].run();
+		printf("%s: %s\n", checks[i].name, ok ? "ok" : "FAILED");
+		failed |= !ok;
+	}
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,247 @@
+#include "stencil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "my_math.h"
+#include "puzzle.h"
+
+u32 emitter_period(struct emitter *e) {
+	switch (e->type) {
+	case EMITTER_FIXED:
+		return e->num_steps;
+	case EMITTER_CLOCKWISE:
+	case EMITTER_COUNTER_CLOCKWISE:
+		return lcm_u32(e->num_steps, NUM_DIRS);
+	}
+	return e->num_steps;
+}
+
+// Sets bit t of bits[dir] if e fires in direction dir on the t'th tick after
+// its current state, for 0 <= t < emitter_period(e). Tick 0 is the one that
+// brought the emitter into its current state.
+static void fire_bits(struct emitter *e, u64 bits[NUM_DIRS]) {
+	struct emitter tmp = *e;
+	u32 period = emitter_period(e);
+	u32 fired = ((1 << (tmp.step - 1)) & tmp.fire_mask) ? tmp.dir_mask : 0;
+	for (u32 d = 0; d < NUM_DIRS; ++d) {
+		bits[d] = 0;
+	}
+	for (u32 t = 0; t < period; ++t) {
+		for (u32 d = 0; d < NUM_DIRS; ++d) {
+			if (fired & (1 << d)) {
+				bits[d] |= 1ull << t;
+			}
+		}
+		fired = step_emitter(&tmp);
+	}
+}
+
+// The shortest d dividing period for which bits repeat every d ticks.
+static u32 shortest_period(u64 bits, u32 period) {
+	for (u32 d = 1; d < period; ++d) {
+		if (period % d) {
+			continue;
+		}
+		u64 rest = bits >> d;
+		u64 mask = period - d == 64 ? ~0ull : (1ull << (period - d)) - 1;
+		if ((bits & mask) == rest) {
+			return d;
+		}
+	}
+	return period;
+}
+
+// Appends emitter i's rays, which the stencil has room for.
+static void trace_emitter(struct stencil *stencil, struct puzzle *puzzle, u32 i) {
+	u32 w = puzzle->width, h = puzzle->height;
+	struct emitter *e = &puzzle->emitters[i];
+	u64 bits[NUM_DIRS];
+	fire_bits(e, bits);
+	for (u32 d = 0; d < NUM_DIRS; ++d) {
+		if (!bits[d]) {
+			continue;
+		}
+		struct ray *ray = &stencil->rays[stencil->num_rays++];
+		ray->emitter   = i;
+		ray->dir       = d;
+		ray->first     = stencil->num_cells;
+		ray->period    = shortest_period(bits[d], emitter_period(e));
+		ray->fire_bits = bits[d] & (ray->period == 64 ? ~0ull : (1ull << ray->period) - 1);
+		u32 x = e->x + dir_dx[d], y = e->y + dir_dy[d];
+		while (x < w && y < h) {
+			enum tile tile = puzzle->tiles[y*w + x];
+			if (tile == TILE_EMITTER || tile == TILE_WALL) {
+				break;
+			}
+			stencil->cells[stencil->num_cells++] = y*w + x;
+			x += dir_dx[d]; y += dir_dy[d];
+		}
+		ray->len = stencil->num_cells - ray->first;
+	}
+}
+
+static void size_stencil(struct stencil *stencil, struct puzzle *puzzle, u32 num_emitters) {
+	u32 max_rays = num_emitters * NUM_DIRS;
+	stencil->num_rays  = 0;
+	stencil->num_cells = 0;
+	stencil->rays  = realloc(stencil->rays, max_rays * sizeof(*stencil->rays));
+	stencil->cells = realloc(stencil->cells,
+	                         max_rays * MAX(puzzle->width, puzzle->height) * sizeof(*stencil->cells));
+}
+
+void build_stencil(struct stencil *stencil, struct puzzle *puzzle) {
+	size_stencil(stencil, puzzle, puzzle->num_emitters);
+	for (u32 i = 0; i < puzzle->num_emitters; ++i) {
+		trace_emitter(stencil, puzzle, i);
+	}
+}
+
+void build_emitter_stencil(struct stencil *stencil, struct puzzle *puzzle, u32 i) {
+	size_stencil(stencil, puzzle, 1);
+	trace_emitter(stencil, puzzle, i);
+}
+
+u64 stencil_period(struct stencil *stencil) {
+	u64 period = 1;
+	for (u32 r = 0; r < stencil->num_rays; ++r) {
+		if (stencil->rays[r].len) {
+			period = lcm_u64(period, stencil->rays[r].period);
+		}
+	}
+	return period;
+}
+
+u64 puzzle_period(struct puzzle *puzzle) {
+	struct stencil stencil = {};
+	build_stencil(&stencil, puzzle);
+	u64 period = stencil_period(&stencil);
+	free_stencil(&stencil);
+	return period;
+}
+
+void free_stencil(struct stencil *stencil) {
+	free(stencil->rays);
+	free(stencil->cells);
+	memset(stencil, 0, sizeof(*stencil));
+}
+
+void steady_state_bullets(struct puzzle *puzzle) {
+	struct stencil stencil = {};
+	build_stencil(&stencil, puzzle);
+	struct bullets *bullets = &puzzle->bullets;
+	u32 num_bullets = 0;
+	u32 w = puzzle->width;
+	memset(puzzle->occupancy, 0, w * puzzle->height);
+	for (u32 r = 0; r < stencil.num_rays; ++r) {
+		struct ray *ray = &stencil.rays[r];
+		struct emitter *e = &puzzle->emitters[ray->emitter];
+		s32 dx = dir_dx[ray->dir], dy = dir_dy[ray->dir];
+		u32 x = e->x, y = e->y;
+		for (u32 m = 1; m <= ray->len; ++m) {
+			x += dx; y += dy;
+			if (ray_occupied(ray, 0, m)) {
+				puzzle->occupancy[y*w + x] |= 1 << ray->dir;
+				bullets->x[num_bullets]  = x;
+				bullets->y[num_bullets]  = y;
+				bullets->dx[num_bullets] = dx;
+				bullets->dy[num_bullets] = dy;
+				++num_bullets;
+			}
+		}
+	}
+	puzzle->num_bullets = num_bullets;
+	free_stencil(&stencil);
+}
+
+// The ticks out of period a ray's m'th cell is occupied, as a period-bit mask:
+// bit k for k ticks on. period is a multiple of the ray's, 64 at most.
+static u64 ray_ticks(struct ray *ray, u32 m, u32 period) {
+	u64 mask = period == 64 ? ~0ull : (1ull << period) - 1;
+	u64 bits = 0;
+	for (u32 q = 0; q < period; q += ray->period) {
+		bits |= ray->fire_bits << q;
+	}
+	// the bullet fired k - (m - 1) ticks on
+	u32 s = (m - 1) % period;
+	if (s) {
+		bits = (bits << s) | (bits >> (period - s));
+	}
+	return bits & mask;
+}
+
+f32 bullet_density(struct puzzle *puzzle, f32 *density) {
+	u32 cells = puzzle->width * puzzle->height;
+	struct stencil stencil = {};
+	build_stencil(&stencil, puzzle);
+	// the rays over cell c are hits[first[c] .. first[c + 1])
+	u32 *first = calloc(cells + 1, sizeof(*first));
+	struct {
+		u32 ray, m;
+	} *hits = malloc(stencil.num_cells * sizeof(*hits));
+	for (u32 i = 0; i < stencil.num_cells; ++i) {
+		++first[stencil.cells[i] + 1];
+	}
+	for (u32 c = 0; c < cells; ++c) {
+		first[c + 1] += first[c];
+	}
+	for (u32 r = 0; r < stencil.num_rays; ++r) {
+		struct ray *ray = &stencil.rays[r];
+		for (u32 m = 1; m <= ray->len; ++m) {
+			u32 c = stencil.cells[ray->first + m - 1];
+			u32 j = first[c]++;
+			hits[j].ray = r; hits[j].m = m;
+		}
+	}
+	// filling moved each first[c] on to first[c + 1]
+	for (u32 c = cells; c > 0; --c) {
+		first[c] = first[c - 1];
+	}
+	first[0] = 0;
+	f32 sum = 0;
+	u32 open = 0;
+	for (u32 c = 0; c < cells; ++c) {
+		enum tile tile = puzzle->tiles[c];
+		if (tile == TILE_EMITTER || tile == TILE_WALL) {
+			density[c] = 1;
+			continue;
+		}
+		u64 period = 1;
+		for (u32 j = first[c]; j < first[c + 1]; ++j) {
+			period = lcm_u64(period, stencil.rays[hits[j].ray].period);
+		}
+		if (period <= 64) {
+			u64 ticks = 0;
+			for (u32 j = first[c]; j < first[c + 1]; ++j) {
+				ticks |= ray_ticks(&stencil.rays[hits[j].ray], hits[j].m, period);
+			}
+			density[c] = (f32)__builtin_popcountll(ticks) / period;
+		} else if (period <= DENSITY_EXACT_PERIOD) {
+			u32 blocked = 0;
+			for (u32 k = 0; k < period; ++k) {
+				for (u32 j = first[c]; j < first[c + 1]; ++j) {
+					if (ray_occupied(&stencil.rays[hits[j].ray], k, hits[j].m)) {
+						++blocked;
+						break;
+					}
+				}
+			}
+			density[c] = (f32)blocked / period;
+		} else {
+			f32 clear = 1;
+			for (u32 j = first[c]; j < first[c + 1]; ++j) {
+				struct ray *ray = &stencil.rays[hits[j].ray];
+				clear *= 1 - (f32)__builtin_popcountll(ray->fire_bits) / ray->period;
+			}
+			density[c] = 1 - clear;
+		}
+		sum += density[c];
+		++open;
+	}
+	free(first);
+	free(hits);
+	free_stencil(&stencil);
+	return open ? sum / open : 0;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "puzzle.h"
+#include "generator.h"
+#include "map.h"
+#include "search.h"
+#include "stencil.h"
+
+// Headless front end to the generator and solver: no SDL, no window.
+
+static const char move_chars[] = {
+	[PLAYER_MOVE_N]     = 'N',
+	[PLAYER_MOVE_E]     = 'E',
+	[PLAYER_MOVE_S]     = 'S',
+	[PLAYER_MOVE_W]     = 'W',
+	[PLAYER_MOVE_PAUSE] = '.',
+};
+
+// Strongly connected regions of the puzzle's space-time graph.
+static void print_regions(struct puzzle *puzzle, struct map_regions *regions) {
+	struct map map = generate_map(puzzle);
+	if (!map.period) {
+		printf("regions: map too big\n");
+		return;
+	}
+	find_map_regions(regions, &map);
+	u32 goal_x = 0, goal_y = 0;
+	for (u32 i = 0; i < puzzle->width * puzzle->height; ++i) {
+		if (puzzle->tiles[i] == TILE_GOAL) {
+			goal_x = i % puzzle->width; goal_y = i / puzzle->width;
+		}
+	}
+	u32 shared = cells_share_region(regions, &map, puzzle->player.x + 1,
+	                                puzzle->player.y + 1, goal_x + 1, goal_y + 1);
+	printf("regions: %u over %u states, largest %u, %u sinks holding %u states, "
+	       "start and goal %s\n", regions->num_regions, regions->num_states,
+	       regions->largest, regions->num_sinks, regions->sink_states,
+	       shared ? "share a region" : "in different regions");
+	free_map(&map);
+}
+
+// Mean bullet density over the open cells and the cell that sees the most.
+static void print_density(struct puzzle *puzzle) {
+	u32 cells = puzzle->width * puzzle->height, hot = cells;
+	f32 *density = malloc(cells * sizeof(*density));
+	f32 mean = bullet_density(puzzle, density);
+	for (u32 c = 0; c < cells; ++c) {
+		enum tile tile = puzzle->tiles[c];
+		if (tile == TILE_EMITTER || tile == TILE_WALL) {
+			continue;
+		}
+		if (hot == cells || density[c] > density[hot]) {
+			hot = c;
+		}
+	}
+	printf("density: mean %.1f%%", mean * 100);
+	if (hot < cells) {
+		printf(", hottest (%u, %u) at %.1f%%", hot % puzzle->width, hot / puzzle->width,
+		       density[hot] * 100);
+	}
+	putchar('\n');
+	free(density);
+}
+
+static void usage(const char *prog) {
+	printf("usage: %s [-v] [-a] [-s seed] [-n count] easy|medium|hard\n", prog);
+}
+
+int main(s32 argc, char *argv[]) {
+	u32 seed = time(NULL), count = 1, verbose = 0, search = 0;
+	u32 (*generate)(struct puzzle *puzzle) = NULL;
+	for (s32 i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-v")) {
+			verbose = 1;
+		} else if (!strcmp(argv[i], "-a")) {
+			search = 1;
+		} else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			seed = strtoul(argv[++i], NULL, 0);
+		} else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			count = strtoul(argv[++i], NULL, 0);
+		} else if (!strcmp(argv[i], "easy")) {
+			generate = generate_easy_puzzle;
+		} else if (!strcmp(argv[i], "medium")) {
+			generate = generate_medium_puzzle;
+		} else if (!strcmp(argv[i], "hard")) {
+			generate = generate_hard_puzzle;
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (generate == NULL) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	printf("Random seed: 0x%x\n", seed);
+	srand(seed);
+
+	struct puzzle puzzle = {};
+	struct solution solution = {};
+	struct map_regions regions = {};
+	s32 status = EXIT_SUCCESS;
+	// -v: the solver's step by step trace
+	solution.trace = verbose ? stderr : NULL;
+	for (u32 i = 0; i < count; ++i) {
+		if (!generate(&puzzle)) {
+			printf("puzzle %u: no candidate could be mapped\n", i);
+			status = EXIT_FAILURE;
+			break;
+		}
+		// -a: A* whatever the size, which doesn't count the shortest solutions
+		if (search) {
+			solve_puzzle_search(&solution, &puzzle);
+		} else {
+			solve_puzzle(&solution, &puzzle);
+		}
+		printf("puzzle %u: %ux%u, %u emitters\n", i, puzzle.width, puzzle.height,
+		       puzzle.num_emitters);
+		print_puzzle(&puzzle);
+		print_regions(&puzzle, &regions);
+		print_density(&puzzle);
+		printf("solution: %u moves, %llu shortest\n", solution.len,
+		       (unsigned long long)solution.paths);
+		for (u32 j = 0; j < solution.len; ++j) {
+			putchar(move_chars[solution.moves[j]]);
+		}
+		putchar('\n');
+	}
+	free_solution(&solution);
+	free_map_regions(&regions);
+	free_puzzle(&puzzle);
+	return status;
+}